@@ -0,0 +1,480 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_BINARYCODEC_H
+#define ASIONET_BINARYCODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include "Message.h"
+#include "Utils.h"
+#include "ByteOrder.h"
+#include "Varint.h"
+
+/**
+ * Declares the fields of a struct which are serialized by the binary codec. Put it inside the struct definition:
+ *
+ *   struct Player
+ *   {
+ *       std::uint32_t id;
+ *       std::string name;
+ *       std::vector<Position> trail;
+ *       ASIONET_FIELDS(id, name, trail)
+ *   };
+ *
+ * Fields are written in the order of declaration without any tags or padding. Supported field types are
+ * bool, integers and enums (big-endian, fixed width), float and double (IEEE 754 bit pattern, big-endian),
+ * integers wrapped by asionet::codec::varint() (LEB128, signed integers are zigzag encoded),
+ * std::vector<std::uint32_t> wrapped by asionet::codec::groupVarint(),
+ * std::string, std::vector of supported types (both prefixed by their varint encoded length) and nested structs
+ * which declare their fields via ASIONET_FIELDS.
+ * Such a struct can be used as the message type of all asionet senders and receivers right away.
+ */
+#define ASIONET_FIELDS(...) \
+	template<typename AsionetVisitor> \
+	void asionetVisitFields(AsionetVisitor && visitor) \
+	{ visitor(__VA_ARGS__); } \
+	template<typename AsionetVisitor> \
+	void asionetVisitFields(AsionetVisitor && visitor) const \
+	{ visitor(__VA_ARGS__); }
+
+namespace asionet
+{
+namespace codec
+{
+
+template<typename Int>
+struct Varint
+{
+	static_assert(std::is_integral<std::remove_const_t<Int>>::value, "varint() requires an integer field.");
+
+	Int & value;
+};
+
+// Marks an integer field inside ASIONET_FIELDS to be encoded as varint.
+template<typename Int>
+Varint<Int> varint(Int & value)
+{ return Varint<Int>{value}; }
+
+template<typename Vector>
+struct GroupVarint
+{
+	static_assert(std::is_same<std::remove_const_t<Vector>, std::vector<std::uint32_t>>::value,
+	              "groupVarint() requires a std::vector<std::uint32_t> field.");
+
+	Vector & values;
+};
+
+// Marks a std::vector<std::uint32_t> field inside ASIONET_FIELDS to be group varint encoded (see utils::encodeGroupVarint).
+// Decoding takes four values at once, so this suits long arrays of small integers like ids or counters.
+template<typename Vector>
+GroupVarint<Vector> groupVarint(Vector & values)
+{ return GroupVarint<Vector>{values}; }
+
+namespace internal
+{
+
+template<typename...>
+using VoidT = void;
+
+struct AnyVisitor
+{
+	template<typename... Fields>
+	void operator()(Fields &&...) const {}
+};
+
+template<typename T, typename = void>
+struct HasFields : std::false_type {};
+
+template<typename T>
+struct HasFields<T, VoidT<decltype(std::declval<const T &>().asionetVisitFields(AnyVisitor{}))>> : std::true_type {};
+
+inline void throwTruncated()
+{ throw std::runtime_error{"asionet::codec: message is truncated."}; }
+
+class Reader
+{
+public:
+	Reader(const char * begin, const char * end)
+		: pos(begin), end(end)
+	{}
+
+	void require(std::size_t numBytes) const
+	{
+		if (numBytes > remaining())
+			throwTruncated();
+	}
+
+	std::size_t remaining() const
+	{ return (std::size_t) (end - pos); }
+
+	const char * position() const
+	{ return pos; }
+
+	const char * take(std::size_t numBytes)
+	{
+		require(numBytes);
+		auto result = pos;
+		pos += numBytes;
+		return result;
+	}
+
+private:
+	const char * pos;
+	const char * end;
+};
+
+using utils::varintSize;
+
+inline void writeVarint(char *& pos, std::uint64_t value)
+{ pos += utils::encodeVarint(value, (std::uint8_t *) pos); }
+
+inline std::uint64_t readVarint(Reader & reader)
+{
+	std::uint64_t value;
+	auto numBytes = utils::decodeVarint((const std::uint8_t *) reader.position(), reader.remaining(), value);
+	if (numBytes == 0)
+	{
+		if (reader.remaining() < utils::MAX_VARINT_SIZE)
+			throwTruncated();
+		throw std::runtime_error{"asionet::codec: varint is too long."};
+	}
+	reader.take(numBytes);
+	return value;
+}
+
+template<typename T, typename Enable = void>
+struct FieldCodec;
+
+// Integers and enums of fixed width.
+template<typename T>
+struct FieldCodec<T, std::enable_if_t<(std::is_integral<T>::value && !std::is_same<T, bool>::value) || std::is_enum<T>::value>>
+{
+	using Unsigned = std::make_unsigned_t<typename std::conditional_t<std::is_enum<T>::value,
+	                                                                  std::underlying_type<T>,
+	                                                                  std::common_type<T>>::type>;
+
+	static constexpr std::size_t size(const T &)
+	{ return sizeof(T); }
+
+	static void write(char *& pos, const T & value)
+	{
+		utils::toBigEndian<sizeof(T)>((std::uint8_t *) pos, (Unsigned) value);
+		pos += sizeof(T);
+	}
+
+	static void read(Reader & reader, T & value)
+	{ value = (T) utils::fromBigEndian<sizeof(T), Unsigned>((const std::uint8_t *) reader.take(sizeof(T))); }
+};
+
+template<>
+struct FieldCodec<bool>
+{
+	static constexpr std::size_t size(const bool &)
+	{ return 1; }
+
+	static void write(char *& pos, const bool & value)
+	{ *pos++ = value ? 1 : 0; }
+
+	static void read(Reader & reader, bool & value)
+	{ value = *reader.take(1) != 0; }
+};
+
+template<typename T>
+struct FieldCodec<T, std::enable_if_t<std::is_floating_point<T>::value>>
+{
+	static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Only 32 and 64 bit floating point fields are supported.");
+
+	using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+
+	static constexpr std::size_t size(const T &)
+	{ return sizeof(T); }
+
+	static void write(char *& pos, const T & value)
+	{
+		Bits bits;
+		std::memcpy(&bits, &value, sizeof(T));
+		FieldCodec<Bits>::write(pos, bits);
+	}
+
+	static void read(Reader & reader, T & value)
+	{
+		Bits bits;
+		FieldCodec<Bits>::read(reader, bits);
+		std::memcpy(&value, &bits, sizeof(T));
+	}
+};
+
+template<typename Int>
+struct FieldCodec<Varint<Int>>
+{
+	using T = std::remove_const_t<Int>;
+	using Unsigned = std::make_unsigned_t<T>;
+
+	static std::uint64_t zigzag(T value)
+	{ return std::is_signed<T>::value ? utils::zigzagEncode((std::int64_t) value) : (std::uint64_t) value; }
+
+	static std::size_t size(const Varint<Int> & field)
+	{ return varintSize(zigzag(field.value)); }
+
+	static void write(char *& pos, const Varint<Int> & field)
+	{ writeVarint(pos, zigzag(field.value)); }
+
+	static void read(Reader & reader, const Varint<Int> & field)
+	{
+		auto encoded = readVarint(reader);
+		auto decoded = std::is_signed<T>::value ? (std::uint64_t) utils::zigzagDecode(encoded) : encoded;
+		auto value = (T) decoded;
+		if (zigzag(value) != encoded)
+			throw std::runtime_error{"asionet::codec: varint exceeds the range of its field."};
+		field.value = value;
+	}
+};
+
+template<typename Vector>
+struct FieldCodec<GroupVarint<Vector>>
+{
+	static std::size_t size(const GroupVarint<Vector> & field)
+	{
+		const auto & values = field.values;
+		std::size_t size = varintSize(values.size()) + (values.size() + 3) / 4;
+		for (auto value : values)
+			size += utils::internal::groupVarintLength(value);
+		return size;
+	}
+
+	static void write(char *& pos, const GroupVarint<Vector> & field)
+	{
+		writeVarint(pos, field.values.size());
+		pos += utils::encodeGroupVarint(field.values.data(), field.values.size(), (std::uint8_t *) pos);
+	}
+
+	static void read(Reader & reader, const GroupVarint<Vector> & field)
+	{
+		auto numValues = readVarint(reader);
+		// Each value occupies at least one byte.
+		reader.require(numValues);
+		field.values.resize((std::size_t) numValues);
+		auto numBytes = utils::decodeGroupVarint(
+			(const std::uint8_t *) reader.position(), reader.remaining(), field.values.data(), field.values.size());
+		if (numBytes == 0 && numValues != 0)
+			throwTruncated();
+		reader.take(numBytes);
+	}
+};
+
+template<>
+struct FieldCodec<std::string>
+{
+	static std::size_t size(const std::string & value)
+	{ return varintSize(value.size()) + value.size(); }
+
+	static void write(char *& pos, const std::string & value)
+	{
+		writeVarint(pos, value.size());
+		std::memcpy(pos, value.data(), value.size());
+		pos += value.size();
+	}
+
+	static void read(Reader & reader, std::string & value)
+	{
+		auto numBytes = readVarint(reader);
+		value.assign(reader.take(numBytes), numBytes);
+	}
+};
+
+// Each element of a vector has to occupy at least one byte. Thus, a corrupted length is detected before allocating.
+template<typename T>
+struct FieldCodec<std::vector<T>>
+{
+	// Vectors of integers, enums and floating point numbers are copied as a whole and converted to big-endian
+	// byte order in bulk.
+	using IsScalarVector = std::integral_constant<bool, (std::is_arithmetic<T>::value || std::is_enum<T>::value)
+	                                                    && !std::is_same<T, bool>::value>;
+
+	static std::size_t size(const std::vector<T> & value)
+	{ return varintSize(value.size()) + elementsSize(value, IsScalarVector{}); }
+
+	static void write(char *& pos, const std::vector<T> & value)
+	{
+		writeVarint(pos, value.size());
+		writeElements(pos, value, IsScalarVector{});
+	}
+
+	static void read(Reader & reader, std::vector<T> & value)
+	{
+		auto numElements = readVarint(reader);
+		reader.require(numElements);
+		readElements(reader, value, (std::size_t) numElements, IsScalarVector{});
+	}
+
+private:
+	static std::size_t elementsSize(const std::vector<T> & value, std::true_type)
+	{ return value.size() * sizeof(T); }
+
+	static std::size_t elementsSize(const std::vector<T> & value, std::false_type)
+	{
+		std::size_t size = 0;
+		for (const auto & element : value)
+			size += FieldCodec<T>::size(element);
+		return size;
+	}
+
+	static void writeElements(char *& pos, const std::vector<T> & value, std::true_type)
+	{
+		auto numBytes = value.size() * sizeof(T);
+		std::memcpy(pos, value.data(), numBytes);
+		if (utils::isLittleEndian())
+			utils::swapByteOrder<sizeof(T)>(pos, value.size());
+		pos += numBytes;
+	}
+
+	static void writeElements(char *& pos, const std::vector<T> & value, std::false_type)
+	{
+		for (const auto & element : value)
+			FieldCodec<T>::write(pos, element);
+	}
+
+	static void readElements(Reader & reader, std::vector<T> & value, std::size_t numElements, std::true_type)
+	{
+		reader.require(numElements * sizeof(T));
+		value.resize(numElements);
+		std::memcpy(value.data(), reader.take(numElements * sizeof(T)), numElements * sizeof(T));
+		utils::bigEndianToHost(value.data(), numElements);
+	}
+
+	static void readElements(Reader & reader, std::vector<T> & value, std::size_t numElements, std::false_type)
+	{
+		value.clear();
+		value.reserve(numElements);
+		for (std::size_t i = 0; i < numElements; ++i)
+		{
+			// std::vector<bool> has no references to its elements, so we read into a separate one.
+			T element{};
+			FieldCodec<T>::read(reader, element);
+			value.push_back(std::move(element));
+		}
+	}
+};
+
+struct SizeVisitor
+{
+	std::size_t & size;
+
+	template<typename... Fields>
+	void operator()(const Fields &... fields) const
+	{
+		int expand[] = {0, (size += FieldCodec<std::decay_t<Fields>>::size(fields), 0)...};
+		(void) expand;
+	}
+};
+
+struct WriteVisitor
+{
+	char *& pos;
+
+	template<typename... Fields>
+	void operator()(const Fields &... fields) const
+	{
+		int expand[] = {0, (FieldCodec<std::decay_t<Fields>>::write(pos, fields), 0)...};
+		(void) expand;
+	}
+};
+
+struct ReadVisitor
+{
+	Reader & reader;
+
+	template<typename... Fields>
+	void operator()(Fields &&... fields) const
+	{
+		int expand[] = {0, (FieldCodec<std::decay_t<Fields>>::read(reader, fields), 0)...};
+		(void) expand;
+	}
+};
+
+template<typename T>
+struct FieldCodec<T, std::enable_if_t<HasFields<T>::value>>
+{
+	static std::size_t size(const T & value)
+	{
+		std::size_t size = 0;
+		value.asionetVisitFields(SizeVisitor{size});
+		return size;
+	}
+
+	static void write(char *& pos, const T & value)
+	{ value.asionetVisitFields(WriteVisitor{pos}); }
+
+	static void read(Reader & reader, T & value)
+	{ value.asionetVisitFields(ReadVisitor{reader}); }
+};
+
+}
+}
+
+namespace message
+{
+
+// The encoded size is computed up front, so encoding needs a single allocation at most.
+template<typename Message>
+struct Encoder<Message, std::enable_if_t<codec::internal::HasFields<Message>::value>>
+{
+	void operator()(const Message & message, std::string & data) const
+	{
+		data.clear();
+		append(message, data);
+	}
+
+	void append(const Message & message, std::string & data) const
+	{
+		using Codec = codec::internal::FieldCodec<Message>;
+		auto offset = data.size();
+		data.resize(offset + Codec::size(message));
+		char * pos = &data[offset];
+		Codec::write(pos, message);
+	}
+};
+
+// Throws if the buffer is truncated. Trailing bytes are ignored, so new fields may be appended to a message
+// without breaking older receivers.
+template<typename Message>
+struct Decoder<Message, std::enable_if_t<codec::internal::HasFields<Message>::value>>
+{
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & buffer, Message & message) const
+	{
+		codec::internal::Reader reader{buffer.data(), buffer.data() + buffer.size()};
+		codec::internal::FieldCodec<Message>::read(reader, message);
+	}
+};
+
+}
+}
+
+#endif //ASIONET_BINARYCODEC_H
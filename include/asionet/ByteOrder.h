@@ -0,0 +1,223 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_BYTEORDER_H
+#define ASIONET_BYTEORDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define ASIONET_BYTEORDER_SIMD
+#endif
+
+namespace asionet
+{
+namespace utils
+{
+namespace internal
+{
+
+#if defined(__GNUC__) || defined(__clang__)
+
+inline std::uint16_t byteSwap(std::uint16_t value)
+{ return __builtin_bswap16(value); }
+
+inline std::uint32_t byteSwap(std::uint32_t value)
+{ return __builtin_bswap32(value); }
+
+inline std::uint64_t byteSwap(std::uint64_t value)
+{ return __builtin_bswap64(value); }
+
+#else
+
+// Other compilers usually recognize these shifts as a byte swap as well.
+inline std::uint16_t byteSwap(std::uint16_t value)
+{ return (std::uint16_t) ((value << 8) | (value >> 8)); }
+
+inline std::uint32_t byteSwap(std::uint32_t value)
+{ return ((std::uint32_t) byteSwap((std::uint16_t) value) << 16) | byteSwap((std::uint16_t) (value >> 16)); }
+
+inline std::uint64_t byteSwap(std::uint64_t value)
+{ return ((std::uint64_t) byteSwap((std::uint32_t) value) << 32) | byteSwap((std::uint32_t) (value >> 32)); }
+
+#endif
+
+template<std::size_t scalarSize>
+using UnsignedOfSize = std::conditional_t<scalarSize == 2, std::uint16_t,
+                                          std::conditional_t<scalarSize == 4, std::uint32_t, std::uint64_t>>;
+
+template<std::size_t scalarSize>
+inline void swapByteOrderScalar(char * data, std::size_t numElements)
+{
+	using Unsigned = UnsignedOfSize<scalarSize>;
+	for (std::size_t i = 0; i < numElements; ++i, data += scalarSize)
+	{
+		Unsigned value;
+		std::memcpy(&value, data, scalarSize);
+		value = byteSwap(value);
+		std::memcpy(data, &value, scalarSize);
+	}
+}
+
+#ifdef ASIONET_BYTEORDER_SIMD
+
+// Shuffle mask which reverses the bytes of each scalar within a 16 byte lane.
+template<std::size_t scalarSize>
+struct ByteSwapMask
+{
+	alignas(32) char bytes[32];
+
+	ByteSwapMask()
+	{
+		for (std::size_t i = 0; i < 32; ++i)
+		{
+			auto lanePos = i % 16;
+			bytes[i] = (char) ((lanePos / scalarSize) * scalarSize + scalarSize - 1 - lanePos % scalarSize);
+		}
+	}
+};
+
+template<std::size_t scalarSize>
+inline const ByteSwapMask<scalarSize> & byteSwapMask()
+{
+	static const ByteSwapMask<scalarSize> mask;
+	return mask;
+}
+
+// Compiled for SSSE3 and AVX2 regardless of the global compiler flags and only called if the CPU supports them.
+template<std::size_t scalarSize>
+__attribute__((target("ssse3")))
+inline void swapByteOrderSsse3(char * data, std::size_t numElements)
+{
+	constexpr std::size_t elementsPerVector = 16 / scalarSize;
+	auto mask = _mm_load_si128((const __m128i *) byteSwapMask<scalarSize>().bytes);
+	std::size_t i = 0;
+	for (; i + elementsPerVector <= numElements; i += elementsPerVector, data += 16)
+	{
+		auto vector = _mm_loadu_si128((const __m128i *) data);
+		_mm_storeu_si128((__m128i *) data, _mm_shuffle_epi8(vector, mask));
+	}
+	swapByteOrderScalar<scalarSize>(data, numElements - i);
+}
+
+template<std::size_t scalarSize>
+__attribute__((target("avx2")))
+inline void swapByteOrderAvx2(char * data, std::size_t numElements)
+{
+	constexpr std::size_t elementsPerVector = 32 / scalarSize;
+	auto mask = _mm256_load_si256((const __m256i *) byteSwapMask<scalarSize>().bytes);
+	std::size_t i = 0;
+	for (; i + elementsPerVector <= numElements; i += elementsPerVector, data += 32)
+	{
+		auto vector = _mm256_loadu_si256((const __m256i *) data);
+		_mm256_storeu_si256((__m256i *) data, _mm256_shuffle_epi8(vector, mask));
+	}
+	swapByteOrderScalar<scalarSize>(data, numElements - i);
+}
+
+inline bool hasAvx2()
+{
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+}
+
+inline bool hasSsse3()
+{
+	static const bool supported = __builtin_cpu_supports("ssse3");
+	return supported;
+}
+
+#endif
+
+template<std::size_t scalarSize>
+inline void swapByteOrder(char * data, std::size_t numElements, std::true_type)
+{
+#ifdef ASIONET_BYTEORDER_SIMD
+	if (hasAvx2())
+		return swapByteOrderAvx2<scalarSize>(data, numElements);
+	if (hasSsse3())
+		return swapByteOrderSsse3<scalarSize>(data, numElements);
+#endif
+	swapByteOrderScalar<scalarSize>(data, numElements);
+}
+
+// Scalars of other sizes, e.g. the 16 bytes of a long double on x86-64, are reversed one by one.
+template<std::size_t scalarSize>
+inline void swapByteOrder(char * data, std::size_t numElements, std::false_type)
+{
+	for (std::size_t i = 0; i < numElements; ++i, data += scalarSize)
+		std::reverse(data, data + scalarSize);
+}
+
+}
+
+inline bool isLittleEndian()
+{
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+	return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+	const std::uint16_t one = 1;
+	return *(const std::uint8_t *) &one == 1;
+#endif
+}
+
+/**
+ * Reverses the byte order of numElements consecutive scalars of scalarSize bytes each in place.
+ * The data does not need to be aligned. Scalars of 2, 4 or 8 bytes are swapped in bulk, on x86-64 with AVX2 or SSSE3
+ * byte shuffles if the CPU supports them.
+ */
+template<std::size_t scalarSize>
+inline void swapByteOrder(void * data, std::size_t numElements)
+{
+	if (scalarSize == 1)
+		return;
+
+	using IsBulkSize = std::integral_constant<bool, scalarSize == 2 || scalarSize == 4 || scalarSize == 8>;
+	internal::swapByteOrder<scalarSize>((char *) data, numElements, IsBulkSize{});
+}
+
+// Converts an array of integers, enums or floating point numbers from host to big-endian byte order in place.
+template<typename T>
+inline void hostToBigEndian(T * data, std::size_t numElements)
+{
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only scalar types are supported.");
+	if (isLittleEndian())
+		swapByteOrder<sizeof(T)>(data, numElements);
+}
+
+// Converts an array of integers, enums or floating point numbers from big-endian to host byte order in place.
+template<typename T>
+inline void bigEndianToHost(T * data, std::size_t numElements)
+{
+	hostToBigEndian(data, numElements);
+}
+
+}
+}
+
+#endif //ASIONET_BYTEORDER_H
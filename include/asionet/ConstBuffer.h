@@ -7,16 +7,19 @@
 
 #include <boost/asio/streambuf.hpp>
 #include <boost/asio.hpp>
+#include "SharedBytes.h"
 
 namespace asionet
 {
 namespace internal
 {
 
+// Both buffer types are views of contiguous memory, so decoders may access the bytes through data() directly.
+
 class ConstStreamBuffer
 {
 public:
-	using ConstIterator = boost::asio::buffers_iterator<boost::asio::streambuf::const_buffers_type>;
+	using ConstIterator = const char *;
 
 	ConstStreamBuffer(boost::asio::streambuf & buffer, std::size_t numBytes, std::size_t offset)
 		: buffer(buffer), numBytes(numBytes), offset(offset)
@@ -26,7 +29,12 @@ public:
 
 	char operator[](std::size_t pos) const
 	{
-		return ((const char *) buffer.data().data())[pos + offset];
+		return data()[pos];
+	}
+
+	const char * data() const
+	{
+		return ((const char *) buffer.data().data()) + offset;
 	}
 
 	std::size_t size() const
@@ -36,12 +44,18 @@ public:
 
 	ConstIterator begin() const
 	{
-		return boost::asio::buffers_begin(buffer.data()) + offset;
+		return data();
 	}
 
 	ConstIterator end() const
 	{
-		return boost::asio::buffers_begin(buffer.data()) + offset + numBytes;
+		return data() + numBytes;
+	}
+
+	// The streambuf cannot give away its memory, so the bytes are copied.
+	SharedBytes share() const
+	{
+		return SharedBytes::copy(data(), numBytes);
 	}
 
 private:
@@ -53,9 +67,65 @@ private:
 class ConstVectorBuffer
 {
 public:
-	using ConstIterator = std::vector<char>::const_iterator;
+	using ConstIterator = const char *;
+
+	explicit ConstVectorBuffer(const std::vector<char> & buffer,
+	                           std::size_t numBytes,
+	                           std::size_t offset,
+	                           std::shared_ptr<const std::vector<char>> owner = nullptr)
+		: buffer(buffer), numBytes(numBytes), offset(offset), owner(std::move(owner))
+	{
+		assert(buffer.size() >= offset + numBytes);
+	}
+
+	char operator[](std::size_t pos) const
+	{
+		return data()[pos];
+	}
+
+	const char * data() const
+	{
+		return buffer.data() + offset;
+	}
+
+	std::size_t size() const
+	{
+		return numBytes;
+	}
+
+	ConstIterator begin() const
+	{
+		return data();
+	}
+
+	ConstIterator end() const
+	{
+		return data() + numBytes;
+	}
+
+	// Shares the underlying vector without copying if it's owned by a shared_ptr.
+	SharedBytes share() const
+	{
+		if (owner)
+			return SharedBytes{owner, offset, numBytes};
+		return SharedBytes::copy(data(), numBytes);
+	}
+
+private:
+	const std::vector<char> & buffer;
+	std::size_t numBytes;
+	std::size_t offset;
+	std::shared_ptr<const std::vector<char>> owner;
+};
+
+// A range of bytes inside another buffer, e.g. the payload behind a message header.
+template<typename ConstBuffer>
+class ConstBufferView
+{
+public:
+	using ConstIterator = const char *;
 
-	explicit ConstVectorBuffer(std::vector<char> & buffer, std::size_t numBytes, std::size_t offset)
+	ConstBufferView(const ConstBuffer & buffer, std::size_t numBytes, std::size_t offset)
 		: buffer(buffer), numBytes(numBytes), offset(offset)
 	{
 		assert(buffer.size() >= offset + numBytes);
@@ -63,7 +133,12 @@ public:
 
 	char operator[](std::size_t pos) const
 	{
-		return buffer[pos + offset];
+		return data()[pos];
+	}
+
+	const char * data() const
+	{
+		return buffer.data() + offset;
 	}
 
 	std::size_t size() const
@@ -73,16 +148,21 @@ public:
 
 	ConstIterator begin() const
 	{
-		return buffer.begin() + offset;
+		return data();
 	}
 
 	ConstIterator end() const
 	{
-		return buffer.begin() + offset + numBytes;
+		return data() + numBytes;
+	}
+
+	SharedBytes share() const
+	{
+		return buffer.share().slice(offset, numBytes);
 	}
 
 private:
-	std::vector<char> buffer;
+	const ConstBuffer & buffer;
 	std::size_t numBytes;
 	std::size_t offset;
 };
@@ -0,0 +1,149 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_CRC32C_H
+#define ASIONET_CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define ASIONET_CRC32C_HARDWARE
+#endif
+
+namespace asionet
+{
+namespace utils
+{
+namespace internal
+{
+
+// Reflected CRC-32C (Castagnoli) polynomial.
+constexpr std::uint32_t CRC32C_POLYNOMIAL = 0x82f63b78;
+
+using Crc32cTable = std::array<std::array<std::uint32_t, 256>, 8>;
+
+inline const Crc32cTable & crc32cTable()
+{
+	static const Crc32cTable table = []
+	{
+		Crc32cTable t{};
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			std::uint32_t crc = i;
+			for (std::size_t bit = 0; bit < 8; ++bit)
+				crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1u)));
+			t[0][i] = crc;
+		}
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			for (std::size_t slice = 1; slice < 8; ++slice)
+				t[slice][i] = (t[slice - 1][i] >> 8) ^ t[0][t[slice - 1][i] & 0xff];
+		}
+		return t;
+	}();
+	return table;
+}
+
+// Portable slicing-by-8 implementation.
+inline std::uint32_t crc32cSoftware(std::uint32_t crc, const std::uint8_t * data, std::size_t numBytes)
+{
+	const auto & table = crc32cTable();
+
+	for (; numBytes >= 8; numBytes -= 8, data += 8)
+	{
+		std::uint32_t low = crc ^ ((std::uint32_t) data[0]
+		                           | ((std::uint32_t) data[1] << 8)
+		                           | ((std::uint32_t) data[2] << 16)
+		                           | ((std::uint32_t) data[3] << 24));
+		crc = table[7][low & 0xff]
+		      ^ table[6][(low >> 8) & 0xff]
+		      ^ table[5][(low >> 16) & 0xff]
+		      ^ table[4][low >> 24]
+		      ^ table[3][data[4]]
+		      ^ table[2][data[5]]
+		      ^ table[1][data[6]]
+		      ^ table[0][data[7]];
+	}
+
+	for (; numBytes > 0; --numBytes, ++data)
+		crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xff];
+
+	return crc;
+}
+
+#ifdef ASIONET_CRC32C_HARDWARE
+
+// Uses the SSE4.2 crc32 instruction. Compiled for SSE4.2 regardless of the global compiler flags
+// and only called if the CPU supports it.
+__attribute__((target("sse4.2")))
+inline std::uint32_t crc32cHardware(std::uint32_t crc, const std::uint8_t * data, std::size_t numBytes)
+{
+	std::uint64_t crc64 = crc;
+	for (; numBytes >= 8; numBytes -= 8, data += 8)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+
+	crc = (std::uint32_t) crc64;
+	for (; numBytes > 0; --numBytes, ++data)
+		crc = _mm_crc32_u8(crc, *data);
+
+	return crc;
+}
+
+inline bool hasHardwareCrc32c()
+{
+	static const bool supported = __builtin_cpu_supports("sse4.2");
+	return supported;
+}
+
+#endif
+
+}
+
+/**
+ * Computes the CRC-32C checksum of the given bytes.
+ * Pass the result of a previous call as 'crc' to continue a checksum over multiple pieces of data.
+ * On x86-64 CPUs with SSE4.2, the hardware crc32 instruction is used, otherwise a portable table-driven fallback.
+ */
+inline std::uint32_t crc32c(const void * data, std::size_t numBytes, std::uint32_t crc = 0)
+{
+	auto bytes = (const std::uint8_t *) data;
+	crc = ~crc;
+#ifdef ASIONET_CRC32C_HARDWARE
+	if (internal::hasHardwareCrc32c())
+		return ~internal::crc32cHardware(crc, bytes, numBytes);
+#endif
+	return ~internal::crc32cSoftware(crc, bytes, numBytes);
+}
+
+}
+}
+
+#endif //ASIONET_CRC32C_H
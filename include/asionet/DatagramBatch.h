@@ -0,0 +1,578 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_DATAGRAMBATCH_H
+#define ASIONET_DATAGRAMBATCH_H
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <boost/asio/ip/udp.hpp>
+#include "ObjectPool.h"
+#include "Frame.h"
+#include "Time.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef IP_MULTICAST_ALL
+#define IP_MULTICAST_ALL 49
+#endif
+#endif
+
+namespace asionet
+{
+namespace socket
+{
+namespace internal
+{
+
+#ifdef __linux__
+constexpr bool SEGMENTATION_OFFLOAD_SUPPORTED = true;
+#else
+constexpr bool SEGMENTATION_OFFLOAD_SUPPORTED = false;
+#endif
+
+// The kernel coalesces at most this many datagrams (UDP_MAX_SEGMENTS of older kernels) into one segmented send.
+constexpr std::size_t MAX_SEGMENTS = 64;
+// Largest datagram which is sent segmented. Larger datagrams might exceed the MTU of an Ethernet link, which would let the
+// kernel reject the whole segmented send.
+constexpr std::size_t MAX_SEGMENT_SIZE = 1500 - 20 - 8;
+// Largest total payload of a segmented send or a coalesced (GRO) receive.
+constexpr std::size_t MAX_SEGMENTED_SIZE = 0xffff - 8 - 40;
+
+/**
+ * Pre-allocated receive slots which are filled with many datagrams at once.
+ * On Linux, receive() reads all pending datagrams (up to maxBatchSize) with a single recvmmsg() call.
+ * Elsewhere, it drains the socket with non-blocking receive_from() calls.
+ * Each slot keeps its buffer across batches. A buffer is only replaced by a fresh one from the pool if it's still
+ * referenced when the next batch is received (e.g. because a message kept it via SharedBytes).
+ *
+ * If UDP_GRO is enabled on the socket (see enableGro()), a slot may hold several coalesced datagrams of the same sender
+ * which are getSegmentSize() bytes each (except for the last one which may be shorter).
+ */
+class DatagramBatch
+{
+public:
+	using Endpoint = boost::asio::ip::udp::endpoint;
+	using BufferPool = utils::ObjectPool<std::vector<char>>;
+
+	DatagramBatch(std::size_t maxBatchSize, std::size_t bufferSize, BufferPool & bufferPool)
+		: bufferSize(bufferSize)
+		  , bufferPool(bufferPool)
+		  , slots(maxBatchSize)
+#ifdef __linux__
+		  , headers(maxBatchSize)
+		  , iovecs(maxBatchSize)
+		  , addresses(maxBatchSize)
+		  , controls(maxBatchSize)
+#endif
+	{}
+
+	DatagramBatch(const DatagramBatch &) = delete;
+
+	DatagramBatch & operator=(const DatagramBatch &) = delete;
+
+	// Receives the pending datagrams without blocking and returns how many slots have been filled.
+	// If no datagram is pending, 0 is returned and error is set to would_block.
+	template<typename DatagramSocket>
+	std::size_t receive(DatagramSocket & socket, boost::system::error_code & error)
+	{
+		error = boost::system::error_code{};
+		prepareSlots();
+
+#ifdef __linux__
+		for (std::size_t i = 0; i < slots.size(); ++i)
+		{
+			iovecs[i].iov_base = slots[i].buffer->data();
+			iovecs[i].iov_len = bufferSize;
+			std::memset(&headers[i], 0, sizeof(headers[i]));
+			auto & header = headers[i].msg_hdr;
+			header.msg_name = &addresses[i];
+			header.msg_namelen = sizeof(addresses[i]);
+			header.msg_iov = &iovecs[i];
+			header.msg_iovlen = 1;
+			header.msg_control = controls[i].data;
+			header.msg_controllen = sizeof(controls[i].data);
+		}
+
+		int numReceived;
+		do
+			numReceived = ::recvmmsg(socket.native_handle(), headers.data(), (unsigned int) slots.size(), MSG_DONTWAIT, nullptr);
+		while (numReceived < 0 && errno == EINTR);
+
+		if (numReceived < 0)
+		{
+			error = boost::system::error_code{errno, boost::asio::error::get_system_category()};
+			return 0;
+		}
+
+		for (std::size_t i = 0; i < (std::size_t) numReceived; ++i)
+		{
+			auto & slot = slots[i];
+			auto & header = headers[i].msg_hdr;
+			// A truncated datagram fails the frame validation since its header announces more bytes.
+			slot.numBytes = headers[i].msg_len;
+			slot.segmentSize = slot.numBytes;
+			slot.hasDropCounter = false;
+			slot.timestamp = time::TimePoint{};
+			auto addressLength = header.msg_namelen;
+			if (addressLength > slot.endpoint.capacity())
+				addressLength = (socklen_t) slot.endpoint.capacity();
+			std::memcpy(slot.endpoint.data(), &addresses[i], addressLength);
+			slot.endpoint.resize(addressLength);
+
+			for (auto message = CMSG_FIRSTHDR(&header); message != nullptr; message = CMSG_NXTHDR(&header, message))
+			{
+				if (message->cmsg_level == SOL_UDP && message->cmsg_type == UDP_GRO)
+				{
+					int segmentSize;
+					std::memcpy(&segmentSize, CMSG_DATA(message), sizeof(segmentSize));
+					if (segmentSize > 0)
+						slot.segmentSize = (std::size_t) segmentSize;
+				}
+#ifdef SCM_TIMESTAMPNS
+				else if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS)
+				{
+					timespec timestamp;
+					std::memcpy(&timestamp, CMSG_DATA(message), sizeof(timestamp));
+					slot.timestamp = time::TimePoint{std::chrono::duration_cast<time::Duration>(
+						std::chrono::seconds{timestamp.tv_sec} + std::chrono::nanoseconds{timestamp.tv_nsec})};
+				}
+#endif
+#ifdef SO_RXQ_OVFL
+				else if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL)
+				{
+					std::memcpy(&slot.dropCounter, CMSG_DATA(message), sizeof(slot.dropCounter));
+					slot.hasDropCounter = true;
+				}
+#endif
+			}
+		}
+
+		return (std::size_t) numReceived;
+#else
+		if (!socket.non_blocking())
+			socket.non_blocking(true, error);
+
+		std::size_t numReceived{0};
+		while (!error && numReceived < slots.size())
+		{
+			auto & slot = slots[numReceived];
+			slot.numBytes = socket.receive_from(
+				boost::asio::buffer(slot.buffer->data(), bufferSize), slot.endpoint, 0, error);
+			slot.segmentSize = slot.numBytes;
+			if (!error)
+				++numReceived;
+		}
+
+		if (numReceived > 0)
+			error = boost::system::error_code{};
+		return numReceived;
+#endif
+	}
+
+	const std::shared_ptr<std::vector<char>> & getBuffer(std::size_t index) const
+	{ return slots[index].buffer; }
+
+	std::size_t getNumBytes(std::size_t index) const
+	{ return slots[index].numBytes; }
+
+	// Equals getNumBytes() unless the slot holds several coalesced datagrams.
+	std::size_t getSegmentSize(std::size_t index) const
+	{ return slots[index].segmentSize; }
+
+	const Endpoint & getEndpoint(std::size_t index) const
+	{ return slots[index].endpoint; }
+
+	// Returns the time at which the kernel received the datagram (see enableTimestamps()) or the clock's epoch if the
+	// kernel didn't pass it along with the datagram.
+	time::TimePoint getTimestamp(std::size_t index) const
+	{ return slots[index].timestamp; }
+
+	// Returns false if the kernel didn't pass its drop counter (see enableDropCounter()) along with the datagram.
+	bool getDropCounter(std::size_t index, std::uint32_t & dropCounter) const
+	{
+		dropCounter = slots[index].dropCounter;
+		return slots[index].hasDropCounter;
+	}
+
+	std::size_t getMaxBatchSize() const
+	{ return slots.size(); }
+
+private:
+	struct Slot
+	{
+		std::shared_ptr<std::vector<char>> buffer;
+		std::size_t numBytes{0};
+		std::size_t segmentSize{0};
+		Endpoint endpoint;
+		std::uint32_t dropCounter{0};
+		bool hasDropCounter{false};
+		time::TimePoint timestamp;
+	};
+
+	std::size_t bufferSize;
+	BufferPool & bufferPool;
+	std::vector<Slot> slots;
+#ifdef __linux__
+	struct Control
+	{
+		alignas(cmsghdr) char data[256];
+	};
+
+	std::vector<mmsghdr> headers;
+	std::vector<iovec> iovecs;
+	std::vector<sockaddr_storage> addresses;
+	std::vector<Control> controls;
+#endif
+
+	void prepareSlots()
+	{
+		for (auto & slot : slots)
+		{
+			if (slot.buffer && slot.buffer.use_count() == 1)
+				continue;
+
+			slot.buffer = bufferPool.acquire();
+			slot.buffer->resize(bufferSize);
+		}
+	}
+};
+
+// Lets the kernel coalesce datagrams of the same flow into a single buffer (see DatagramBatch). Returns false if the
+// option isn't supported.
+template<typename DatagramSocket>
+bool enableGro(DatagramSocket & socket, bool enabled)
+{
+#ifdef __linux__
+	int value = enabled ? 1 : 0;
+	return ::setsockopt(socket.native_handle(), SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+#else
+	return !enabled;
+#endif
+}
+
+// Lets the kernel pass the number of datagrams it dropped so far (because the socket's receive buffer was full) along
+// with each received datagram. Returns false if SO_RXQ_OVFL isn't supported.
+template<typename DatagramSocket>
+bool enableDropCounter(DatagramSocket & socket, bool enabled)
+{
+#ifdef SO_RXQ_OVFL
+	int value = enabled ? 1 : 0;
+	return ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_RXQ_OVFL, &value, sizeof(value)) == 0;
+#else
+	return !enabled;
+#endif
+}
+
+// Lets the kernel pass the (system clock) time at which it received each datagram (SO_TIMESTAMPNS). Returns false if
+// receive timestamps aren't supported.
+template<typename DatagramSocket>
+bool enableTimestamps(DatagramSocket & socket, bool enabled)
+{
+#ifdef SO_TIMESTAMPNS
+	int value = enabled ? 1 : 0;
+	return ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof(value)) == 0;
+#else
+	return !enabled;
+#endif
+}
+
+// Sets the size of the socket's receive (SO_RCVBUF) or send (SO_SNDBUF) buffer. If force is set, SO_RCVBUFFORCE or
+// SO_SNDBUFFORCE is tried first which may exceed the system's limit (net.core.rmem_max or wmem_max) but requires
+// CAP_NET_ADMIN. Returns the size which the kernel actually uses.
+template<typename DatagramSocket>
+std::size_t setBufferSize(DatagramSocket & socket, bool receiveBuffer, std::size_t size, bool force)
+{
+#if defined(SO_RCVBUFFORCE) && defined(SO_SNDBUFFORCE)
+	int value = (int) size;
+	bool forced = force && ::setsockopt(socket.native_handle(), SOL_SOCKET,
+	                                    receiveBuffer ? SO_RCVBUFFORCE : SO_SNDBUFFORCE, &value, sizeof(value)) == 0;
+#else
+	bool forced = false;
+#endif
+	// Without permission, fall back to the limited size.
+	if (!forced)
+	{
+		if (receiveBuffer)
+			socket.set_option(boost::asio::socket_base::receive_buffer_size{(int) size});
+		else
+			socket.set_option(boost::asio::socket_base::send_buffer_size{(int) size});
+	}
+
+	if (receiveBuffer)
+	{
+		boost::asio::socket_base::receive_buffer_size option;
+		socket.get_option(option);
+		return (std::size_t) option.value();
+	}
+
+	boost::asio::socket_base::send_buffer_size option;
+	socket.get_option(option);
+	return (std::size_t) option.value();
+}
+
+// Lets several sockets bind to the same port while the kernel load balances incoming datagrams between them (by a hash
+// of the sender's address). Must be set before binding. Returns false if SO_REUSEPORT isn't supported.
+template<typename DatagramSocket>
+bool enableReusePort(DatagramSocket & socket)
+{
+#ifdef SO_REUSEPORT
+	int value = 1;
+	return ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) == 0;
+#else
+	return false;
+#endif
+}
+
+// Lets the socket only receive datagrams of multicast groups it has joined itself. By default, Linux delivers datagrams
+// of a group to all sockets bound to the port as soon as any socket on the host has joined that group.
+template<typename DatagramSocket>
+void restrictMulticastToJoinedGroups(DatagramSocket & socket)
+{
+#ifdef __linux__
+	int value = 0;
+	::setsockopt(socket.native_handle(), IPPROTO_IP, IP_MULTICAST_ALL, &value, sizeof(value));
+#endif
+}
+
+struct OutgoingDatagram
+{
+	const asionet::internal::Frame * frame;
+	boost::asio::ip::udp::endpoint endpoint;
+};
+
+/**
+ * A datagram socket which may be used by other threads while it's opened, closed and reopened, e.g. by a timeout
+ * (see closeable::Closer). Those threads hold lockShared() while they use the socket. Elsewhere than on Linux, the
+ * socket is switched to non-blocking mode as soon as it's opened since changing the mode isn't thread-safe either.
+ */
+class GuardedDatagramSocket : public boost::asio::ip::udp::socket
+{
+public:
+	using Socket = boost::asio::ip::udp::socket;
+
+	template<typename ExecutionContext>
+	explicit GuardedDatagramSocket(ExecutionContext & context)
+		: Socket(context)
+	{}
+
+	void open(const boost::asio::ip::udp & protocol)
+	{
+		std::lock_guard<std::shared_timed_mutex> lock{mutex};
+		Socket::open(protocol);
+#ifndef __linux__
+		Socket::non_blocking(true);
+#endif
+	}
+
+	void close(boost::system::error_code & error)
+	{
+		std::lock_guard<std::shared_timed_mutex> lock{mutex};
+		Socket::close(error);
+	}
+
+	std::shared_lock<std::shared_timed_mutex> lockShared()
+	{
+		return std::shared_lock<std::shared_timed_mutex>{mutex};
+	}
+
+private:
+	std::shared_timed_mutex mutex;
+};
+
+// Sends a single datagram without blocking and without allocating. Sets error to would_block if the socket's send
+// buffer is full. Elsewhere than on Linux, the socket has to be in non-blocking mode already.
+template<typename DatagramSocket>
+void sendDatagram(DatagramSocket & socket, const OutgoingDatagram & datagram, boost::system::error_code & error)
+{
+	auto buffers = datagram.frame->getBufferArray();
+
+#ifdef __linux__
+	constexpr auto numBuffers = std::tuple_size<decltype(buffers)>::value;
+	iovec iovecs[numBuffers];
+	for (std::size_t i = 0; i < numBuffers; ++i)
+	{
+		iovecs[i].iov_base = const_cast<void *>(buffers[i].data());
+		iovecs[i].iov_len = buffers[i].size();
+	}
+
+	msghdr header{};
+	header.msg_name = const_cast<void *>((const void *) datagram.endpoint.data());
+	header.msg_namelen = (socklen_t) datagram.endpoint.size();
+	header.msg_iov = iovecs;
+	header.msg_iovlen = numBuffers;
+
+	ssize_t numSent;
+	do
+		numSent = ::sendmsg(socket.native_handle(), &header, MSG_DONTWAIT);
+	while (numSent < 0 && errno == EINTR);
+
+	error = numSent < 0
+	        ? boost::system::error_code{errno, boost::asio::error::get_system_category()}
+	        : boost::system::error_code{};
+#else
+	socket.send_to(buffers, datagram.endpoint, 0, error);
+#endif
+}
+
+// Returns how many of the given datagrams are sent as one segmented (UDP_SEGMENT) message, i.e. how many consecutive
+// datagrams have the same endpoint and the same size as the first one (only the last one may be shorter).
+// Returns 1 if the datagrams are not eligible for segmentation.
+inline std::size_t numSegments(const OutgoingDatagram * datagrams, std::size_t numDatagrams, std::size_t maxSegments)
+{
+	auto segmentSize = datagrams[0].frame->getSize();
+	if (segmentSize > MAX_SEGMENT_SIZE)
+		return 1;
+
+	std::size_t totalSize{segmentSize};
+	std::size_t count{1};
+	while (count < numDatagrams && count < maxSegments)
+	{
+		auto size = datagrams[count].frame->getSize();
+		if (size > segmentSize || datagrams[count].endpoint != datagrams[0].endpoint
+		    || totalSize + size > MAX_SEGMENTED_SIZE)
+			break;
+
+		totalSize += size;
+		++count;
+		if (size < segmentSize)
+			break;
+	}
+	return count;
+}
+
+/**
+ * Sends each frame as a datagram to its endpoint without blocking and returns how many datagrams have been sent.
+ * On Linux, all datagrams are passed to a single sendmmsg() call. Elsewhere, they are sent with non-blocking send_to()
+ * calls. If not even the first datagram could be sent, 0 is returned and error is set (would_block if the socket's send
+ * buffer is full).
+ *
+ * If maxSegments is larger than 1, consecutive datagrams which are eligible for UDP segmentation offload (see
+ * numSegments()) are passed to the kernel as a single message which is split into datagrams by the kernel or the NIC.
+ * Such a message is sent or fails as a whole. Segmentation is ignored if SEGMENTATION_OFFLOAD_SUPPORTED is false.
+ */
+template<typename DatagramSocket>
+std::size_t sendDatagrams(DatagramSocket & socket,
+                          const OutgoingDatagram * datagrams,
+                          std::size_t numDatagrams,
+                          boost::system::error_code & error,
+                          std::size_t maxSegments = 1)
+{
+	error = boost::system::error_code{};
+
+#ifdef __linux__
+	constexpr std::size_t controlSize = CMSG_SPACE(sizeof(std::uint16_t));
+
+	std::vector<mmsghdr> headers(numDatagrams);
+	std::vector<std::size_t> messageSizes(numDatagrams);
+	// Each frame consists of up to 3 buffers: header, data and checksum trailer.
+	std::vector<iovec> iovecs(3 * numDatagrams);
+	std::vector<char> controls(maxSegments > 1 ? numDatagrams * controlSize : 0);
+	std::vector<boost::asio::const_buffer> buffers;
+	std::size_t numMessages{0};
+	std::size_t numIovecs{0};
+	for (std::size_t i = 0; i < numDatagrams; i += messageSizes[numMessages++])
+	{
+		auto count = maxSegments > 1 ? numSegments(datagrams + i, numDatagrams - i, maxSegments) : 1;
+		messageSizes[numMessages] = count;
+
+		buffers.clear();
+		for (std::size_t j = i; j < i + count; ++j)
+			datagrams[j].frame->appendBuffers(buffers);
+
+		auto & header = headers[numMessages].msg_hdr;
+		header.msg_iov = &iovecs[numIovecs];
+		header.msg_iovlen = buffers.size();
+		for (const auto & buffer : buffers)
+		{
+			iovecs[numIovecs].iov_base = const_cast<void *>(buffer.data());
+			iovecs[numIovecs].iov_len = buffer.size();
+			++numIovecs;
+		}
+		header.msg_name = const_cast<void *>((const void *) datagrams[i].endpoint.data());
+		header.msg_namelen = (socklen_t) datagrams[i].endpoint.size();
+
+		if (count > 1)
+		{
+			header.msg_control = &controls[numMessages * controlSize];
+			header.msg_controllen = controlSize;
+			auto message = CMSG_FIRSTHDR(&header);
+			message->cmsg_level = SOL_UDP;
+			message->cmsg_type = UDP_SEGMENT;
+			message->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+			auto segmentSize = (std::uint16_t) datagrams[i].frame->getSize();
+			std::memcpy(CMSG_DATA(message), &segmentSize, sizeof(segmentSize));
+		}
+	}
+
+	int numSent;
+	do
+		numSent = ::sendmmsg(socket.native_handle(), headers.data(), (unsigned int) numMessages, MSG_DONTWAIT);
+	while (numSent < 0 && errno == EINTR);
+
+	if (numSent < 0)
+	{
+		error = boost::system::error_code{errno, boost::asio::error::get_system_category()};
+		return 0;
+	}
+
+	std::size_t numDatagramsSent{0};
+	for (std::size_t i = 0; i < (std::size_t) numSent; ++i)
+		numDatagramsSent += messageSizes[i];
+	return numDatagramsSent;
+#else
+	if (!socket.non_blocking())
+		socket.non_blocking(true, error);
+
+	std::size_t numSent{0};
+	while (!error && numSent < numDatagrams)
+	{
+		socket.send_to(datagrams[numSent].frame->getBuffers(), datagrams[numSent].endpoint, 0, error);
+		if (!error)
+			++numSent;
+	}
+
+	if (numSent > 0)
+		error = boost::system::error_code{};
+	return numSent;
+#endif
+}
+
+}
+}
+}
+
+#endif //ASIONET_DATAGRAMBATCH_H
@@ -24,15 +24,33 @@
 #ifndef ASIONET_DATAGRAMRECEIVER_H
 #define ASIONET_DATAGRAMRECEIVER_H
 
+#include <mutex>
 #include "Stream.h"
 #include "Socket.h"
 #include "Message.h"
 #include "Context.h"
 #include "AsyncOperationManager.h"
+#include "ObjectPool.h"
+#include "DatagramBatch.h"
+#include "Fragmentation.h"
+#include "WorkSerializer.h"
 
 namespace asionet
 {
 
+// A datagram of a batch (see DatagramReceiver::asyncReceiveBatch()). The message is only valid if error is not set.
+template<typename Message>
+struct ReceivedDatagram
+{
+	error::Error error{error::success};
+	Message message;
+	boost::asio::ip::udp::endpoint senderEndpoint;
+	// Number of datagrams the kernel dropped since the previous datagram was received (see enableDropCounter()).
+	std::uint32_t numDropped{0};
+	// Time at which the kernel received the datagram (see enableTimestamps()). The clock's epoch if unavailable.
+	time::TimePoint timestamp;
+};
+
 template<typename Message>
 class DatagramReceiver
 {
@@ -45,55 +63,304 @@ public:
 		void(const error::Error & error,
 			 Message & message,
 			 const Endpoint & senderEndpoint)>;
+	using RawMessage = message::RawMessage<Message>;
+	using RawReceiveHandler = std::function<
+		void(const error::Error & error,
+		     const RawMessage & message,
+		     const Endpoint & senderEndpoint)>;
+	using TimestampedReceiveHandler = std::function<
+		void(const error::Error & error,
+		     Message & message,
+		     const Endpoint & senderEndpoint,
+		     time::TimePoint timestamp)>;
+	using BatchReceiveHandler = std::function<
+		void(const error::Error & error,
+		     std::vector<ReceivedDatagram<Message>> & datagrams)>;
 
-	DatagramReceiver(asionet::Context & context, std::uint16_t bindingPort, std::size_t maxMessageSize = 512)
+	DatagramReceiver(asionet::Context & context,
+	                 std::uint16_t bindingPort,
+	                 std::size_t maxMessageSize = 512,
+	                 std::size_t maxBatchSize = 64)
 		: context(context)
 		  , bindingPort(bindingPort)
 		  , socket(context)
-		  , buffer(maxMessageSize + Frame::HEADER_SIZE)
+		  , bufferSize(maxMessageSize + Frame::HEADER_SIZE + Frame::CHECKSUM_SIZE)
+		  , maxBatchSize(maxBatchSize)
 		  , operationManager(context, [this]{ this->cancelOperation(); })
 	{}
 
 	void asyncReceive(time::Duration timeout, ReceiveHandler handler)
+	{
+		asyncReceiveRaw(
+			timeout,
+			[handler = std::move(handler)](const auto & error, const auto & rawMessage, const auto & senderEndpoint)
+			{
+				Message message;
+				if (!error && !rawMessage.decode(message))
+				{
+					handler(error::decoding, message, senderEndpoint);
+					return;
+				}
+				handler(error, message, senderEndpoint);
+			});
+	}
+
+	// Passes the message to the handler without decoding it. See message::RawMessage.
+	void asyncReceiveRaw(time::Duration timeout, RawReceiveHandler handler)
 	{
 		auto asyncOperation = [this](auto && ... args)
 		{ this->asyncReceiveOperation(std::forward<decltype(args)>(args)...); };
 		operationManager.startOperation(asyncOperation, timeout, handler);
 	}
 
+	/**
+	 * Waits until at least one datagram is pending and then receives up to maxBatchSize datagrams at once.
+	 * On Linux, a whole batch is read with a single recvmmsg() call into pre-allocated buffers. Thus, there is only one
+	 * system call, timer and handler invocation per batch instead of per datagram.
+	 * The handler's error only refers to the receive operation itself. Invalid frames or messages which could not be
+	 * decoded are reported by the error of the corresponding ReceivedDatagram.
+	 */
+	void asyncReceiveBatch(time::Duration timeout, BatchReceiveHandler handler)
+	{
+		auto asyncOperation = [this](auto && ... args)
+		{ this->asyncReceiveBatchOperation(std::forward<decltype(args)>(args)...); };
+		operationManager.startOperation(asyncOperation, timeout, handler);
+	}
+
+	/**
+	 * Keeps receiving datagrams and calls the handler for each of them until the receiver is canceled, another receive
+	 * operation is started or an error occurs. Datagrams are read in batches like in asyncReceiveBatch(), but the wait
+	 * for the socket stays armed without setting up any per-datagram state like timers or handler objects.
+	 * Invalid frames or messages which could not be decoded are passed to the handler with the corresponding error
+	 * and receiving continues. Any other error is passed to the handler once and stops receiving.
+	 */
+	void startReceiving(ReceiveHandler handler)
+	{
+		startReceiving(time::Duration::zero(), std::move(handler));
+	}
+
+	// Stops receiving with an aborted error if no datagram has been received for idleTimeout (if larger than zero).
+	void startReceiving(time::Duration idleTimeout, ReceiveHandler handler)
+	{
+		startReceivingTimestamped(
+			idleTimeout,
+			[handler = std::move(handler)](const auto & error, auto & message, const auto & senderEndpoint, auto)
+			{ handler(error, message, senderEndpoint); });
+	}
+
+	// Like startReceiving() but also passes the time at which the kernel received each datagram (see enableTimestamps()).
+	void startReceivingTimestamped(TimestampedReceiveHandler handler)
+	{
+		startReceivingTimestamped(time::Duration::zero(), std::move(handler));
+	}
+
+	void startReceivingTimestamped(time::Duration idleTimeout, TimestampedReceiveHandler handler)
+	{
+		auto asyncOperation = [this](auto && ... args)
+		{ this->startReceivingOperation(std::forward<decltype(args)>(args)...); };
+		operationManager.startOperation(asyncOperation, idleTimeout, handler);
+	}
+
 	void cancel()
 	{
 		operationManager.cancelOperation();
 	}
 
+	// Subscribes to an IPv4 multicast group on the given local interface (chosen by the kernel if unspecified).
+	// Binds the socket. Groups are joined again if the socket has to be reopened, e.g. after cancel().
+	// Once a group has been joined, the receiver only receives multicast datagrams of its own groups.
+	void joinGroup(const boost::asio::ip::address_v4 & group,
+	               const boost::asio::ip::address_v4 & interfaceAddress = boost::asio::ip::address_v4::any())
+	{
+		setupSocket();
+		std::lock_guard<std::mutex> lock{multicastMutex};
+		socket::internal::restrictMulticastToJoinedGroups(socket);
+		socket.set_option(boost::asio::ip::multicast::join_group(group, interfaceAddress));
+		multicastGroups.emplace_back(group, interfaceAddress);
+	}
+
+	void joinGroup(const std::string & group, const std::string & interfaceAddress = "0.0.0.0")
+	{
+		joinGroup(boost::asio::ip::make_address_v4(group), boost::asio::ip::make_address_v4(interfaceAddress));
+	}
+
+	void leaveGroup(const boost::asio::ip::address_v4 & group)
+	{
+		std::lock_guard<std::mutex> lock{multicastMutex};
+		for (auto it = multicastGroups.begin(); it != multicastGroups.end();)
+		{
+			if (it->first != group)
+			{
+				++it;
+				continue;
+			}
+
+			if (socket.is_open())
+				socket.set_option(boost::asio::ip::multicast::leave_group(it->first, it->second));
+			it = multicastGroups.erase(it);
+		}
+	}
+
+	void leaveGroup(const std::string & group)
+	{
+		leaveGroup(boost::asio::ip::make_address_v4(group));
+	}
+
+	/**
+	 * Sets the size of the socket's receive buffer (SO_RCVBUF) which holds datagrams until they are received.
+	 * A larger buffer lets the receiver survive bursts or pauses without losing datagrams. The kernel limits the size to
+	 * net.core.rmem_max unless force is set and the process has the CAP_NET_ADMIN capability (SO_RCVBUFFORCE).
+	 * Binds the socket and returns the size which the kernel actually uses (Linux doubles the requested size to account
+	 * for its bookkeeping overhead). The size is set again if the socket has to be reopened.
+	 */
+	std::size_t setReceiveBufferSize(std::size_t size, bool force = false)
+	{
+		receiveBufferSize = size;
+		forceReceiveBufferSize = force;
+		setupSocket();
+		return socket::internal::setBufferSize(socket, true, receiveBufferSize, forceReceiveBufferSize);
+	}
+
+	/**
+	 * Lets the kernel report how many datagrams it dropped because the receive buffer was full (SO_RXQ_OVFL, Linux only).
+	 * Batch and continuous receive operations then set the numDropped field of each ReceivedDatagram and accumulate the
+	 * drops in getNumDropped(). Binds the socket. Returns false if the drop counter isn't supported.
+	 */
+	bool enableDropCounter(bool enabled = true)
+	{
+		dropCounter = enabled;
+		setupSocket();
+		return socket::internal::enableDropCounter(socket, enabled);
+	}
+
+	/**
+	 * Lets the kernel pass the time at which it received each datagram (SO_TIMESTAMPNS, Linux only). Batch receive
+	 * operations set the timestamp field of each ReceivedDatagram, continuous ones pass it to a handler given to
+	 * startReceivingTimestamped(). The timestamps refer to the system clock, just like time::now().
+	 * Binds the socket. Returns false if receive timestamps aren't supported.
+	 */
+	bool enableTimestamps(bool enabled = true)
+	{
+		timestamps = enabled;
+		setupSocket();
+		return socket::internal::enableTimestamps(socket, enabled);
+	}
+
+	// Total number of dropped datagrams which have been reported so far (see enableDropCounter()).
+	std::uint64_t getNumDropped() const
+	{
+		return numDropped;
+	}
+
+	/**
+	 * Lets other receivers with enabled SO_REUSEPORT bind to the same port. The kernel then distributes incoming
+	 * datagrams between them by a hash of the sender's address (see ShardedDatagramReceiver). Takes effect when the
+	 * socket is bound, so call it before receiving or joining groups.
+	 */
+	void enableReusePort(bool enabled = true)
+	{
+		reusePort = enabled;
+	}
+
+	/**
+	 * Enables UDP generic receive offload (Linux only): the kernel may coalesce consecutive datagrams of the same sender
+	 * into a single buffer, e.g. those of a DatagramSender with enabled GSO. The receive operations split them into
+	 * separate datagrams again. asyncReceive() then receives batches as well and passes their datagrams on one at a
+	 * time. Each batch slot holds up to 64 KiB. Binds the socket. Must not be called while a receive operation is
+	 * pending. Returns false if GRO isn't supported.
+	 */
+	bool enableGro(bool enabled = true)
+	{
+		gro = enabled;
+		batch.reset();
+		setupSocket();
+		return socket::internal::enableGro(socket, enabled);
+	}
+
+	/**
+	 * Reassembles messages which a DatagramSender split into fragments (see DatagramSender::enableFragmentation()).
+	 * maxMessageSize then only limits the size of a single datagram whereas reassembled messages may be larger. The
+	 * receive buffers are enlarged to hold fragments of the sender's default size if necessary. The fragments of a
+	 * message which didn't all arrive within the timeout are dropped. So are those of the oldest incomplete messages if
+	 * the buffered fragments would exceed maxMemory bytes. asyncReceive() then receives batches as well and passes
+	 * their datagrams on one at a time. Must not be called while a receive operation is pending.
+	 */
+	void enableReassembly(time::Duration timeout = std::chrono::seconds{1}, std::size_t maxMemory = 0x1000000)
+	{
+		reassembler = std::make_unique<fragment::internal::Reassembler>(timeout, maxMemory, bufferPool);
+		bufferSize = std::max<std::size_t>(bufferSize, socket::internal::MAX_SEGMENT_SIZE);
+		batch.reset();
+	}
+
 private:
 	asionet::Context & context;
 	std::uint16_t bindingPort;
 	Socket socket;
-	std::vector<char> buffer;
+	std::size_t bufferSize;
+	// Each receive operation gets its own buffer from the pool. A buffer which has been moved into a message
+	// (see SharedBytes) is returned to the pool as soon as the message releases it.
+	utils::ObjectPool<std::vector<char>> bufferPool;
+	std::size_t maxBatchSize;
+	// Created by the first batch receive operation.
+	std::unique_ptr<socket::internal::DatagramBatch> batch;
+	// Number of slots filled by the last batch and the position of its first unread datagram. Batch and continuous
+	// receive operations read all datagrams of a batch whereas asyncReceive() only reads one of them at a time.
+	std::size_t numFilledSlots{0};
+	std::size_t nextSlot{0};
+	std::size_t nextOffset{0};
+	// Dropped datagrams which haven't been passed along with a datagram yet.
+	std::uint32_t unreportedDrops{0};
+	// Created by enableReassembly().
+	std::unique_ptr<fragment::internal::Reassembler> reassembler;
+	bool gro{false};
+	bool reusePort{false};
+	std::size_t receiveBufferSize{0};
+	bool forceReceiveBufferSize{false};
+	bool dropCounter{false};
+	bool timestamps{false};
+	// The kernel's drop counter when the last datagram was received.
+	std::uint32_t lastDropCounter{0};
+	std::atomic<std::uint64_t> numDropped{0};
+	std::mutex multicastMutex;
+	// Joined multicast groups and their interfaces.
+	std::vector<std::pair<boost::asio::ip::address_v4, boost::asio::ip::address_v4>> multicastGroups;
 	AsyncOperationManager<PendingOperationReplacer> operationManager;
 
 	struct AsyncState
 	{
 		AsyncState(DatagramReceiver<Message> & receiver,
-		           ReceiveHandler && handler)
+		           RawReceiveHandler && handler)
 			: handler(std::move(handler))
 			  , finishedNotifier(receiver.operationManager)
 		{}
 
-		ReceiveHandler handler;
+		RawReceiveHandler handler;
+		// Only used if reassembly or GRO is enabled.
+		time::TimePoint deadline;
 		AsyncOperationManager<PendingOperationReplacer>::FinishedOperationNotifier finishedNotifier;
 	};
 
-	void asyncReceiveOperation(time::Duration & timeout, ReceiveHandler & handler)
+	void asyncReceiveOperation(time::Duration & timeout, RawReceiveHandler & handler)
 	{
 		setupSocket();
 
 		auto state = std::make_shared<AsyncState>(*this, std::move(handler));
+		// A single datagram can neither hold the fragments of a message nor be split if the kernel coalesced several
+		// datagrams into it. Thus, we receive batches instead and pass their datagrams on one at a time.
+		if (reassembler || gro)
+		{
+			setupBatch();
+			state->deadline = time::now() + timeout;
+			waitForMessage(std::move(state));
+			return;
+		}
 
-		message::asyncReceiveDatagram<Message>(
-			socket, buffer, timeout,
-			[this, state = std::move(state)] (const auto & error, auto & message, const auto & senderEndpoint)
+		auto buffer = bufferPool.acquire();
+		buffer->resize(bufferSize);
+
+		message::internal::asyncReceiveDatagramRaw<Message>(
+			socket, std::move(buffer), timeout,
+			[this, state = std::move(state)] (const auto & error, const auto & message, const auto & senderEndpoint)
 			{
 				if (operationManager.isCanceled())
 					return;
@@ -103,6 +370,390 @@ private:
 			});
 	}
 
+	struct BatchAsyncState
+	{
+		BatchAsyncState(DatagramReceiver<Message> & receiver,
+		                BatchReceiveHandler && handler,
+		                time::TimePoint deadline)
+			: handler(std::move(handler))
+			  , deadline(deadline)
+			  , finishedNotifier(receiver.operationManager)
+		{}
+
+		BatchReceiveHandler handler;
+		time::TimePoint deadline;
+		AsyncOperationManager<PendingOperationReplacer>::FinishedOperationNotifier finishedNotifier;
+	};
+
+	struct ContinuousAsyncState
+	{
+		ContinuousAsyncState(DatagramReceiver<Message> & receiver,
+		                     TimestampedReceiveHandler && handler,
+		                     time::Duration idleTimeout)
+			: handler(std::move(handler))
+			  , idleTimeout(idleTimeout)
+			  , serializer(receiver.context)
+			  , idleTimer(receiver.context)
+			  , finishedNotifier(receiver.operationManager)
+		{}
+
+		TimestampedReceiveHandler handler;
+		time::Duration idleTimeout;
+		time::TimePoint lastReceiveTime;
+		bool stopped{false};
+		// Serializes the socket's wait handler with the idle timer's handler.
+		WorkSerializer serializer;
+		boost::asio::basic_waitable_timer<time::Clock> idleTimer;
+		AsyncOperationManager<PendingOperationReplacer>::FinishedOperationNotifier finishedNotifier;
+	};
+
+	void setupBatch()
+	{
+		if (batch)
+			return;
+
+		// Coalesced datagrams don't fit into a buffer of bufferSize bytes.
+		auto batchBufferSize = gro ? std::max<std::size_t>(bufferSize, 0x10000) : bufferSize;
+		batch = std::make_unique<socket::internal::DatagramBatch>(maxBatchSize, batchBufferSize, bufferPool);
+		numFilledSlots = 0;
+	}
+
+	// Waits until a whole message has been received, i.e. a datagram which isn't a fragment or the last missing
+	// fragment of a message.
+	void waitForMessage(std::shared_ptr<AsyncState> state)
+	{
+		waitUntilReadable(
+			state->deadline,
+			[this, state](const auto & error)
+			{
+				if (operationManager.isCanceled())
+					return;
+
+				std::vector<char> noBytes;
+				asionet::internal::ConstVectorBuffer noMessage{noBytes, 0, 0};
+				if (error)
+				{
+					state->finishedNotifier.notify();
+					state->handler(error, RawMessage{noMessage}, Endpoint{});
+					return;
+				}
+
+				boost::system::error_code receiveError;
+				receiveBatch(receiveError);
+				if (receiveError == boost::asio::error::would_block)
+				{
+					waitForMessage(state);
+					return;
+				}
+
+				if (receiveError)
+				{
+					state->finishedNotifier.notify();
+					state->handler(
+						error::Error{error::codes::failedOperation, receiveError}, RawMessage{noMessage}, Endpoint{});
+					return;
+				}
+
+				// The remaining datagrams of the batch are left for the next receive operation.
+				auto received = false;
+				forEachFrame(
+					[this, &state, &received](const auto & frameError, const auto & buffer, std::size_t index, std::uint32_t)
+					{
+						received = true;
+						state->finishedNotifier.notify();
+						state->handler(frameError, RawMessage{buffer}, batch->getEndpoint(index));
+						return false;
+					});
+
+				if (!received)
+					waitForMessage(state);
+			});
+	}
+
+	// Calls the handler once the socket is readable or right away (but asynchronously) if datagrams of the last batch
+	// haven't been read yet.
+	template<typename Handler>
+	void waitUntilReadable(time::TimePoint deadline, const Handler & handler)
+	{
+		if (hasUnreadDatagrams())
+		{
+			context.post([handler] { handler(error::success); });
+			return;
+		}
+
+		auto asyncOperation = [this](auto && ... args)
+		{ socket.async_wait(std::forward<decltype(args)>(args)...); };
+
+		closeable::timedAsyncOperation(asyncOperation, socket, deadline - time::now(), handler, Socket::wait_read);
+	}
+
+	bool hasUnreadDatagrams() const
+	{
+		return batch && nextSlot < numFilledSlots;
+	}
+
+	// Receives the next batch unless datagrams of the last one haven't been read yet.
+	void receiveBatch(boost::system::error_code & error)
+	{
+		error = boost::system::error_code{};
+		if (hasUnreadDatagrams())
+			return;
+
+		numFilledSlots = batch->receive(socket, error);
+		nextSlot = 0;
+		nextOffset = 0;
+	}
+
+	/**
+	 * Validates the frame of each unread datagram of the last batch and passes its data to the visitor along with its
+	 * slot and the number of datagrams which the kernel dropped before it. Fragments are only passed on as the whole
+	 * message once it has been reassembled. Stops after the visitor returned false.
+	 */
+	template<typename Visitor>
+	void forEachFrame(Visitor && visitor)
+	{
+		auto stopped = false;
+		while (!stopped && nextSlot < numFilledSlots)
+		{
+			auto index = nextSlot;
+			// A slot holds several datagrams if the kernel coalesced them (see enableGro()).
+			auto numBytes = batch->getNumBytes(index);
+			auto segmentSize = std::max<std::size_t>(batch->getSegmentSize(index), 1);
+
+			std::uint32_t slotDropCounter;
+			if (nextOffset == 0 && batch->getDropCounter(index, slotDropCounter))
+			{
+				// The counter is cumulative and may wrap around.
+				auto slotNumDropped = slotDropCounter - lastDropCounter;
+				lastDropCounter = slotDropCounter;
+				numDropped += slotNumDropped;
+				unreportedDrops += slotNumDropped;
+			}
+
+			// The cursor moves on before the visitor may start the next receive operation.
+			auto offset = nextOffset;
+			nextOffset += segmentSize;
+			if (nextOffset >= numBytes)
+			{
+				++nextSlot;
+				nextOffset = 0;
+			}
+
+			readFrame(
+				index, offset, std::min(segmentSize, numBytes - offset),
+				[&](const error::Error & error, const asionet::internal::ConstVectorBuffer & buffer)
+				{
+					auto frameNumDropped = unreportedDrops;
+					unreportedDrops = 0;
+					stopped = !visitor(error, buffer, index, frameNumDropped);
+				});
+		}
+	}
+
+	// Decodes each unread datagram of the last batch and passes it to the visitor.
+	template<typename Visitor>
+	void forEachDatagram(Visitor && visitor)
+	{
+		forEachFrame(
+			[this, &visitor](const auto & error, const auto & buffer, std::size_t index, std::uint32_t numDropped)
+			{
+				ReceivedDatagram<Message> datagram;
+				datagram.error = error;
+				datagram.senderEndpoint = batch->getEndpoint(index);
+				if (!error && !message::internal::decode(buffer, datagram.message))
+					datagram.error = error::decoding;
+				datagram.numDropped = numDropped;
+				datagram.timestamp = batch->getTimestamp(index);
+				visitor(datagram);
+				return true;
+			});
+	}
+
+	void startReceivingOperation(time::Duration & idleTimeout, TimestampedReceiveHandler & handler)
+	{
+		setupSocket();
+		setupBatch();
+
+		auto state = std::make_shared<ContinuousAsyncState>(*this, std::move(handler), idleTimeout);
+		if (state->idleTimeout > time::Duration::zero())
+		{
+			state->lastReceiveTime = time::now();
+			waitForIdleTimeout(state);
+		}
+		waitForDatagrams(std::move(state));
+	}
+
+	void waitForDatagrams(std::shared_ptr<ContinuousAsyncState> state)
+	{
+		auto & serializer = state->serializer;
+		auto handler = [this, state](const boost::system::error_code & boostCode)
+		{
+			if (state->stopped)
+				return;
+
+			if (operationManager.isCanceled())
+			{
+				// The idle timer holds on to the state and thus keeps the next operation from starting.
+				state->stopped = true;
+				boost::system::error_code ignoredError;
+				state->idleTimer.cancel(ignoredError);
+				return;
+			}
+
+			if (boostCode)
+			{
+				stopReceiving(*state, boostCode);
+				return;
+			}
+
+			boost::system::error_code receiveError;
+			receiveBatch(receiveError);
+			if (receiveError && receiveError != boost::asio::error::would_block)
+			{
+				stopReceiving(*state, receiveError);
+				return;
+			}
+
+			if (hasUnreadDatagrams())
+				state->lastReceiveTime = time::now();
+
+			forEachDatagram(
+				[&state](auto & datagram)
+				{
+					state->handler(datagram.error, datagram.message, datagram.senderEndpoint, datagram.timestamp);
+				});
+
+			waitForDatagrams(state);
+		};
+
+		// Datagrams of the last batch may have been left unread by asyncReceive().
+		if (hasUnreadDatagrams())
+		{
+			boost::asio::post(serializer, [handler] { handler(boost::system::error_code{}); });
+			return;
+		}
+
+		socket.async_wait(Socket::wait_read, serializer(std::move(handler)));
+	}
+
+	void waitForIdleTimeout(std::shared_ptr<ContinuousAsyncState> state)
+	{
+		auto & serializer = state->serializer;
+		state->idleTimer.expires_at(state->lastReceiveTime + state->idleTimeout);
+		state->idleTimer.async_wait(
+			serializer([this, state = std::move(state)](const boost::system::error_code & boostCode)
+			           {
+				           if (boostCode || operationManager.isCanceled() || state->stopped)
+					           return;
+
+				           if (time::now() < state->lastReceiveTime + state->idleTimeout)
+				           {
+					           waitForIdleTimeout(state);
+					           return;
+				           }
+
+				           // Just like the other timeouts, closing the socket lets the pending wait fail.
+				           closeable::Closer<Socket>::close(socket);
+			           }));
+	}
+
+	void stopReceiving(ContinuousAsyncState & state, const boost::system::error_code & boostCode)
+	{
+		state.stopped = true;
+		boost::system::error_code ignoredError;
+		state.idleTimer.cancel(ignoredError);
+
+		// Closing the socket may complete the wait before is_open() turns false.
+		auto aborted = !socket.is_open() || boostCode == boost::asio::error::operation_aborted;
+		auto result = aborted ? error::aborted : error::Error{error::codes::failedOperation, boostCode};
+		Message message;
+		state.finishedNotifier.notify();
+		state.handler(result, message, Endpoint{}, time::TimePoint{});
+	}
+
+	void asyncReceiveBatchOperation(time::Duration & timeout, BatchReceiveHandler & handler)
+	{
+		setupSocket();
+		setupBatch();
+
+		waitForBatch(std::make_shared<BatchAsyncState>(*this, std::move(handler), time::now() + timeout));
+	}
+
+	void waitForBatch(std::shared_ptr<BatchAsyncState> state)
+	{
+		waitUntilReadable(
+			state->deadline,
+			[this, state](const auto & error)
+			{
+				if (operationManager.isCanceled())
+					return;
+
+				std::vector<ReceivedDatagram<Message>> datagrams;
+				if (error)
+				{
+					state->finishedNotifier.notify();
+					state->handler(error, datagrams);
+					return;
+				}
+
+				boost::system::error_code receiveError;
+				receiveBatch(receiveError);
+				if (receiveError == boost::asio::error::would_block)
+				{
+					// Spurious wakeup. Wait again for the remaining time.
+					waitForBatch(state);
+					return;
+				}
+
+				if (receiveError)
+				{
+					state->finishedNotifier.notify();
+					state->handler(error::Error{error::codes::failedOperation, receiveError}, datagrams);
+					return;
+				}
+
+				datagrams.reserve(numFilledSlots - nextSlot);
+				forEachDatagram([&datagrams](auto & datagram) { datagrams.push_back(std::move(datagram)); });
+
+				state->finishedNotifier.notify();
+				state->handler(error::success, datagrams);
+			});
+	}
+
+	// Passes the data of the datagram which is numBytes bytes at offset in the given slot to the visitor.
+	// A fragment is only passed on if it completes its message. Then, the whole message is passed instead.
+	template<typename Visitor>
+	void readFrame(std::size_t index, std::size_t offset, std::size_t numBytes, Visitor && visitor)
+	{
+		using asionet::internal::ConstVectorBuffer;
+
+		const auto & buffer = batch->getBuffer(index);
+		auto bytes = buffer->data() + offset;
+		if (reassembler && fragment::internal::isFragment(bytes, numBytes))
+		{
+			fragment::internal::Fragment fragment;
+			if (!fragment::internal::parseFragment(bytes, numBytes, fragment))
+			{
+				visitor(error::invalidFrame, ConstVectorBuffer{*buffer, 0, 0});
+				return;
+			}
+
+			auto message = reassembler->add(batch->getEndpoint(index), fragment);
+			if (message)
+				visitor(error::success, ConstVectorBuffer{*message, message->size(), 0, message});
+			return;
+		}
+
+		std::size_t numDataBytes{0};
+		if (!socket::internal::numDataBytesFromBuffer(bytes, numBytes, numDataBytes))
+		{
+			visitor(error::invalidFrame, ConstVectorBuffer{*buffer, 0, 0});
+			return;
+		}
+
+		visitor(error::success, ConstVectorBuffer{*buffer, numDataBytes, offset + Frame::HEADER_SIZE, buffer});
+	}
+
 	void cancelOperation()
 	{
 		closeable::Closer<Socket>::close(socket);
@@ -114,9 +765,27 @@ private:
 			return;
 
 		socket.open(Protocol::v4());
+		// The kernel's drop counter belongs to the socket and starts at zero again.
+		lastDropCounter = 0;
 		socket.set_option(boost::asio::socket_base::reuse_address{true});
 		socket.set_option(boost::asio::socket_base::broadcast{true});
+		if (reusePort && !socket::internal::enableReusePort(socket))
+			throw std::runtime_error{"asionet::DatagramReceiver: SO_REUSEPORT is not supported."};
 		socket.bind(Endpoint(Protocol::v4(), bindingPort));
+		if (gro)
+			socket::internal::enableGro(socket, true);
+		if (receiveBufferSize > 0)
+			socket::internal::setBufferSize(socket, true, receiveBufferSize, forceReceiveBufferSize);
+		if (dropCounter)
+			socket::internal::enableDropCounter(socket, true);
+		if (timestamps)
+			socket::internal::enableTimestamps(socket, true);
+
+		std::lock_guard<std::mutex> lock{multicastMutex};
+		if (!multicastGroups.empty())
+			socket::internal::restrictMulticastToJoinedGroups(socket);
+		for (const auto & group : multicastGroups)
+			socket.set_option(boost::asio::ip::multicast::join_group(group.first, group.second));
 	}
 };
 
@@ -24,14 +24,26 @@
 #ifndef ASIONET_DATAGRAMSENDER_H
 #define ASIONET_DATAGRAMSENDER_H
 
+#include <deque>
+#include <mutex>
 #include "Stream.h"
 #include "Message.h"
 #include "Utils.h"
 #include "AsyncOperationManager.h"
+#include "DatagramBatch.h"
+#include "Fragmentation.h"
 
 namespace asionet
 {
 
+/**
+ * Sends messages as datagrams.
+ * Messages which are sent while a previous batch is still in progress are queued. As soon as the socket is ready, all
+ * queued messages (up to maxBatchSize) are sent with a single system call (sendmmsg() on Linux). Each handler is still
+ * called with the result of its own message.
+ * Since all messages of a batch share a single asynchronous operation, they also share a single timeout which is the
+ * largest timeout of the batch's messages.
+ */
 template<typename Message>
 class DatagramSender
 {
@@ -39,11 +51,13 @@ public:
 	using SendHandler = std::function<void(const error::Error & error)>;
 	using Protocol = boost::asio::ip::udp;
 	using Endpoint = Protocol::endpoint;
-	using Socket = Protocol::socket;
+	using Socket = socket::internal::GuardedDatagramSocket;
+	using Frame = asionet::internal::Frame;
 
-	explicit DatagramSender(asionet::Context & context)
+	explicit DatagramSender(asionet::Context & context, std::size_t maxBatchSize = 64)
 		: context(context)
 		  , socket(context)
+		  , maxBatchSize(maxBatchSize)
 		  , operationManager(context, [this] { this->cancelOperation(); })
 	{}
 
@@ -61,7 +75,7 @@ public:
 				   time::Duration timeout,
 				   SendHandler handler)
 	{
-		auto data = std::make_shared<std::string>();
+		auto data = encodeBufferPool.acquire();
 		if (!message::internal::encode(message, *data))
 		{
 			context.post(
@@ -69,33 +83,236 @@ public:
 			return;
 		}
 
-		auto asyncOperation = [this](auto && ... args)
-		{ this->asyncSendOperation(std::forward<decltype(args)>(args)...); };
-		operationManager.startOperation(asyncOperation, data, endpoint, timeout, handler);
+		asyncSend(std::shared_ptr<const std::string>{std::move(data)}, endpoint, timeout, std::move(handler));
+	}
+
+	// Sends bytes which already hold an encoded message without copying them.
+	// The string is kept alive until the handler has been called and must not be modified in the meantime.
+	void asyncSend(std::shared_ptr<const std::string> data,
+	               const std::string & ip,
+	               std::uint16_t port,
+	               time::Duration timeout,
+	               SendHandler handler)
+	{
+		asyncSend(std::move(data), Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler);
+	}
+
+	void asyncSend(std::shared_ptr<const std::string> data,
+	               Endpoint endpoint,
+	               time::Duration timeout,
+	               SendHandler handler)
+	{
+		if (data->size() > Frame::MAX_DATA_SIZE)
+		{
+			// The size would overflow into the header's flags.
+			context.post([handler] { handler(error::encoding); });
+			return;
+		}
+
+		auto fragmentSize = maxDatagramSize.load();
+		if (fragmentSize > 0 && Frame::HEADER_SIZE + data->size() + Frame::CHECKSUM_SIZE > fragmentSize)
+		{
+			asyncSendFragments(*data, endpoint, timeout, std::move(handler), fragmentSize);
+			return;
+		}
+
+		if (concurrent && trySend(*data, endpoint, handler))
+			return;
+
+		auto send = std::make_unique<PendingSend>(std::move(data), endpoint, timeout, std::move(handler), checksum);
+		enqueue(&send, 1);
 	}
 
+	// Cancels the batch in progress and drops all queued messages without calling their handlers.
 	void cancel()
 	{
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			pendingSends.clear();
+		}
 		operationManager.cancelOperation();
 	}
 
+	// Appends a CRC-32C checksum to each outgoing frame which lets the receiver detect corrupted frames.
+	void enableChecksum(bool enabled = true)
+	{
+		checksum = enabled;
+	}
+
+	/**
+	 * Enables UDP generic segmentation offload (Linux only). Consecutive messages of a batch which go to the same
+	 * endpoint and have the same size (except for the last one which may be shorter) are passed to the kernel as a
+	 * single buffer which is split into datagrams by the kernel or the NIC. If such a buffer can't be sent, all of its
+	 * messages fail. Returns false if segmentation offload isn't supported on this platform.
+	 */
+	bool enableGso(bool enabled = true)
+	{
+		segmentation = enabled && socket::internal::SEGMENTATION_OFFLOAD_SUPPORTED;
+		return segmentation || !enabled;
+	}
+
+	/**
+	 * In concurrent mode, asyncSend() sends the datagram right away on the calling thread with a non-blocking system
+	 * call instead of waiting for previously queued sends to complete. Thus, many threads may send over the same
+	 * sender at once. The handler is still called asynchronously. Only if the socket's send buffer is full, the message
+	 * is queued and sent as part of the next batch. Therefore, datagrams may be sent in a different order than
+	 * asyncSend() was called. Opens the socket. Must not be called while sends are pending.
+	 */
+	void enableConcurrentSends(bool enabled = true)
+	{
+		setupSocket();
+		concurrent = enabled;
+	}
+
+	/**
+	 * Splits each message whose frame would exceed maxDatagramSize bytes into fragments which are sent as separate
+	 * datagrams. A DatagramReceiver with enabled reassembly puts them back together (see
+	 * DatagramReceiver::enableReassembly()). The default size fits into an Ethernet frame which spares the fragments IP
+	 * fragmentation. The fragments of a message are queued together, so GSO (see enableGso()) sends them with a single
+	 * system call. The handler is called once all fragments have been sent, with the error of the first failed one.
+	 * Since a message is lost if any of its fragments is lost, large messages are more likely to be lost.
+	 * Messages which need more than 65535 fragments fail. A size of zero disables fragmentation.
+	 */
+	void enableFragmentation(std::size_t maxDatagramSize = socket::internal::MAX_SEGMENT_SIZE)
+	{
+		if (maxDatagramSize > 0 &&
+		    maxDatagramSize <= Frame::HEADER_SIZE + Frame::CHECKSUM_SIZE + fragment::internal::HEADER_SIZE)
+			throw std::runtime_error{"asionet::DatagramSender: datagram size is too small for fragments."};
+
+		this->maxDatagramSize = maxDatagramSize;
+	}
+
+	// Sends multicast datagrams over the local interface with the given address instead of the kernel's choice.
+	void setMulticastInterface(const boost::asio::ip::address_v4 & interfaceAddress)
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		multicastOptions.interfaceAddress = interfaceAddress;
+		multicastOptions.configured = true;
+		applyMulticastOptions();
+	}
+
+	void setMulticastInterface(const std::string & interfaceAddress)
+	{
+		setMulticastInterface(boost::asio::ip::make_address_v4(interfaceAddress));
+	}
+
+	// Number of router hops a multicast datagram may take (1 by default, i.e. it stays in the local network).
+	void setMulticastTtl(int ttl)
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		multicastOptions.ttl = ttl;
+		multicastOptions.configured = true;
+		applyMulticastOptions();
+	}
+
+	// Whether multicast datagrams are also delivered to subscribers on this host (enabled by default).
+	void setMulticastLoopback(bool enabled)
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		multicastOptions.loopback = enabled;
+		multicastOptions.configured = true;
+		applyMulticastOptions();
+	}
+
+	/**
+	 * Sets the size of the socket's send buffer (SO_SNDBUF). The kernel limits the size to net.core.wmem_max unless
+	 * force is set and the process has the CAP_NET_ADMIN capability (SO_SNDBUFFORCE). Opens the socket and returns the
+	 * size which the kernel actually uses. The size is set again if the socket has to be reopened.
+	 */
+	std::size_t setSendBufferSize(std::size_t size, bool force = false)
+	{
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			sendBufferSize = size;
+			forceSendBufferSize = force;
+		}
+		setupSocket();
+		return socket::internal::setBufferSize(socket, false, size, force);
+	}
+
 private:
+	struct MulticastOptions
+	{
+		boost::asio::ip::address_v4 interfaceAddress{boost::asio::ip::address_v4::any()};
+		int ttl{1};
+		bool loopback{true};
+		// The options are only applied to the socket once one of them has been set.
+		bool configured{false};
+	};
+
+	struct PendingSend
+	{
+		PendingSend(std::shared_ptr<const std::string> && data,
+		            const Endpoint & endpoint,
+		            const time::Duration & timeout,
+		            SendHandler && handler,
+		            bool checksum,
+		            std::uint32_t flags = 0)
+			: data(std::move(data))
+			  , frame((const std::uint8_t *) this->data->data(), this->data->size(), checksum, flags)
+			  , endpoint(endpoint)
+			  , timeout(timeout)
+			  , handler(std::move(handler))
+		{}
+
+		std::shared_ptr<const std::string> data;
+		Frame frame;
+		Endpoint endpoint;
+		time::Duration timeout;
+		SendHandler handler;
+		error::Error error{error::success};
+	};
+
+	// Calls the handler of a fragmented message once each of its fragments has been sent or failed.
+	struct FragmentedSend
+	{
+		FragmentedSend(SendHandler && handler, std::size_t numPending)
+			: handler(std::move(handler))
+			  , numPending(numPending)
+		{}
+
+		void complete(const error::Error & fragmentError)
+		{
+			if (fragmentError && !error)
+				error = fragmentError;
+			if (--numPending == 0)
+				handler(error);
+		}
+
+		SendHandler handler;
+		std::size_t numPending;
+		error::Error error{error::success};
+	};
+
 	asionet::Context & context;
 	Socket socket;
+	std::size_t maxBatchSize;
 	AsyncOperationManager<PendingOperationQueue> operationManager;
+	std::atomic<bool> checksum{false};
+	std::atomic<bool> segmentation{false};
+	std::atomic<bool> concurrent{false};
+	// Zero if fragmentation is disabled.
+	std::atomic<std::size_t> maxDatagramSize{0};
+	std::atomic<std::uint32_t> nextMessageId{0};
+	message::internal::EncodeBufferPool encodeBufferPool;
+	std::mutex mutex;
+	std::deque<std::unique_ptr<PendingSend>> pendingSends;
+	// Set while a batch operation is running or about to be started.
+	bool sending{false};
+	MulticastOptions multicastOptions;
+	std::size_t sendBufferSize{0};
+	bool forceSendBufferSize{false};
 
 	struct AsyncState
 	{
-		AsyncState(DatagramSender<Message> & sender,
-		           std::shared_ptr<std::string> && data,
-		           SendHandler && handler)
-			: data(std::move(data))
-			  , handler(std::move(handler))
-			  , finishedNotifier(sender.operationManager)
+		explicit AsyncState(DatagramSender<Message> & sender)
+			: finishedNotifier(sender.operationManager)
 		{}
 
-		std::shared_ptr<std::string> data;
-		SendHandler handler;
+		std::vector<std::unique_ptr<PendingSend>> sends;
+		std::vector<socket::internal::OutgoingDatagram> datagrams;
+		std::size_t numSent{0};
+		time::TimePoint deadline;
 		AsyncOperationManager<PendingOperationQueue>::FinishedOperationNotifier finishedNotifier;
 	};
 
@@ -104,25 +321,172 @@ private:
 		closeable::Closer<Socket>::close(socket);
 	}
 
-	void asyncSendOperation(std::shared_ptr<std::string> & data,
-	                        Endpoint & endpoint,
-	                        time::Duration & timeout,
-	                        SendHandler & handler)
+	// Sends the datagram without blocking and posts the handler. Returns false if the datagram has to be queued instead.
+	bool trySend(const std::string & data, const Endpoint & endpoint, SendHandler & handler)
+	{
+		Frame frame{(const std::uint8_t *) data.data(), (std::uint32_t) data.size(), checksum};
+		boost::system::error_code sendError;
+		{
+			// Keeps the batch operation and cancel() from closing or reopening the socket in the meantime.
+			auto lock = socket.lockShared();
+			// The socket is reopened by the next batch after it has been closed by cancel() or a timeout.
+			if (!socket.is_open())
+				return false;
+
+			socket::internal::sendDatagram(socket, socket::internal::OutgoingDatagram{&frame, endpoint}, sendError);
+		}
+		if (sendError == boost::asio::error::would_block)
+			return false;
+
+		auto result = sendError ? error::Error{error::codes::failedOperation, sendError} : error::success;
+		context.post([handler = std::move(handler), result] { handler(result); });
+		return true;
+	}
+
+	void asyncSendFragments(const std::string & data,
+	                        const Endpoint & endpoint,
+	                        time::Duration timeout,
+	                        SendHandler handler,
+	                        std::size_t fragmentSize)
+	{
+		// Room for the checksum is always reserved, so enableChecksum() doesn't change the number of fragments.
+		auto maxDataSize = fragmentSize - Frame::HEADER_SIZE - Frame::CHECKSUM_SIZE;
+		auto fragments = fragment::internal::split(data, maxDataSize, nextMessageId++);
+		if (fragments.empty())
+		{
+			context.post(
+				[handler] { handler(error::failedOperation); });
+			return;
+		}
+
+		auto fragmentedSend = std::make_shared<FragmentedSend>(std::move(handler), fragments.size());
+		std::vector<std::unique_ptr<PendingSend>> sends;
+		sends.reserve(fragments.size());
+		for (auto & fragmentData : fragments)
+		{
+			sends.push_back(std::make_unique<PendingSend>(
+				std::move(fragmentData), endpoint, timeout,
+				[fragmentedSend](const auto & error) { fragmentedSend->complete(error); },
+				checksum, std::uint32_t{Frame::FRAGMENT_FLAG}));
+		}
+		enqueue(sends.data(), sends.size());
+	}
+
+	void enqueue(std::unique_ptr<PendingSend> * sends, std::size_t numSends)
+	{
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			for (std::size_t i = 0; i < numSends; ++i)
+				pendingSends.push_back(std::move(sends[i]));
+			if (sending)
+				return;
+
+			sending = true;
+		}
+
+		startBatchOperation();
+	}
+
+	void startBatchOperation()
+	{
+		auto asyncOperation = [this] { this->asyncSendBatchOperation(); };
+		operationManager.startOperation(asyncOperation);
+	}
+
+	void asyncSendBatchOperation()
 	{
 		setupSocket();
 
-		// keep reference because of std::move()
-		auto & dataRef = *data;
+		auto state = std::make_shared<AsyncState>(*this);
+		auto timeout = time::Duration::zero();
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			while (!pendingSends.empty() && state->sends.size() < maxBatchSize)
+			{
+				timeout = std::max(timeout, pendingSends.front()->timeout);
+				state->sends.push_back(std::move(pendingSends.front()));
+				pendingSends.pop_front();
+			}
+		}
+
+		state->datagrams.reserve(state->sends.size());
+		for (const auto & send : state->sends)
+			state->datagrams.push_back(socket::internal::OutgoingDatagram{&send->frame, send->endpoint});
+		state->deadline = time::now() + timeout;
+
+		// The queue may have been cleared by cancel() in the meantime.
+		if (state->sends.empty())
+		{
+			finishBatch(*state);
+			return;
+		}
+
+		sendBatch(std::move(state));
+	}
 
-		auto state = std::make_shared<AsyncState>(*this, std::move(data), std::move(handler));
+	void sendBatch(std::shared_ptr<AsyncState> state)
+	{
+		auto asyncOperation = [this](auto && ... args)
+		{ socket.async_wait(std::forward<decltype(args)>(args)...); };
 
-		asionet::socket::asyncSendTo(
-			socket, dataRef, endpoint, timeout,
-			[this, state = std::move(state)](const auto & error)
+		closeable::timedAsyncOperation(
+			asyncOperation, socket, state->deadline - time::now(),
+			[this, state](const auto & error)
 			{
-				state->finishedNotifier.notify();
-				state->handler(error);
-			});
+				auto & sends = state->sends;
+				auto maxSegments = segmentation ? socket::internal::MAX_SEGMENTS : 1;
+				while (!error && state->numSent < sends.size())
+				{
+					boost::system::error_code sendError;
+					auto datagrams = state->datagrams.data() + state->numSent;
+					auto numDatagrams = sends.size() - state->numSent;
+					auto numSent = socket::internal::sendDatagrams(
+						socket, datagrams, numDatagrams, sendError, maxSegments);
+
+					if (sendError == boost::asio::error::would_block)
+					{
+						// The send buffer is full. Wait until it has room again.
+						this->sendBatch(state);
+						return;
+					}
+
+					if (sendError)
+					{
+						// Skip the datagram(s) which could not be sent, e.g. because a datagram is too large.
+						auto numFailed = socket::internal::numSegments(datagrams, numDatagrams, maxSegments);
+						for (std::size_t i = 0; i < numFailed; ++i)
+							sends[state->numSent++]->error = error::Error{error::codes::failedOperation, sendError};
+						continue;
+					}
+
+					state->numSent += numSent;
+				}
+
+				for (std::size_t i = state->numSent; i < sends.size(); ++i)
+					sends[i]->error = error;
+
+				for (const auto & send : sends)
+					send->handler(send->error);
+
+				this->finishBatch(*state);
+			},
+			Socket::wait_write);
+	}
+
+	void finishBatch(AsyncState & state)
+	{
+		state.finishedNotifier.notify();
+
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			if (pendingSends.empty())
+			{
+				sending = false;
+				return;
+			}
+		}
+
+		startBatchOperation();
 	}
 
 	void setupSocket()
@@ -132,6 +496,22 @@ private:
 
 		socket.open(Protocol::v4());
 		socket.set_option(boost::asio::socket_base::broadcast{true});
+
+		std::lock_guard<std::mutex> lock{mutex};
+		if (sendBufferSize > 0)
+			socket::internal::setBufferSize(socket, false, sendBufferSize, forceSendBufferSize);
+		applyMulticastOptions();
+	}
+
+	// Must be called with a locked mutex.
+	void applyMulticastOptions()
+	{
+		if (!multicastOptions.configured || !socket.is_open())
+			return;
+
+		socket.set_option(boost::asio::ip::multicast::outbound_interface(multicastOptions.interfaceAddress));
+		socket.set_option(boost::asio::ip::multicast::hops(multicastOptions.ttl));
+		socket.set_option(boost::asio::ip::multicast::enable_loopback(multicastOptions.loopback));
 	}
 };
 
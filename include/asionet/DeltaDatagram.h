@@ -0,0 +1,384 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_DELTADATAGRAM_H
+#define ASIONET_DELTADATAGRAM_H
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+#include "DatagramSender.h"
+#include "DatagramReceiver.h"
+#include "SharedBytes.h"
+#include "Varint.h"
+
+namespace asionet
+{
+namespace delta
+{
+namespace internal
+{
+
+/**
+ * Each delta datagram starts with a kind byte and the 4 byte big-endian id of the sender's current keyframe.
+ * A keyframe carries the encoded message and becomes the new baseline. A delta carries the encoded message XORed
+ * with the baseline, compressed as a sequence of (number of unchanged bytes, number of changed bytes, changed bytes)
+ * runs. A full message is sent if a delta would not be smaller. It does not change the baseline.
+ */
+constexpr std::uint8_t KEYFRAME = 0;
+constexpr std::uint8_t DELTA = 1;
+constexpr std::uint8_t FULL = 2;
+constexpr std::size_t HEADER_SIZE = 5;
+
+// Isolated unchanged bytes are cheaper to copy along with the changed bytes than to start a new run.
+constexpr std::size_t MIN_UNCHANGED_RUN = 3;
+
+inline void appendVarint(std::string & data, std::uint64_t value)
+{
+	std::uint8_t bytes[utils::MAX_VARINT_SIZE];
+	data.append((const char *) bytes, utils::encodeVarint(value, bytes));
+}
+
+inline std::uint64_t readVarint(const char *& pos, const char * end)
+{
+	std::uint64_t value;
+	auto numBytes = utils::decodeVarint((const std::uint8_t *) pos, (std::size_t) (end - pos), value);
+	if (numBytes == 0)
+		throw std::runtime_error{"asionet::delta: invalid delta."};
+	pos += numBytes;
+	return value;
+}
+
+// Appends the delta which turns baseline into message to 'data'.
+inline void encodeDelta(const std::string & baseline, const std::string & message, std::string & data)
+{
+	auto numBytes = message.size();
+	auto changed = [&](std::size_t i)
+	{ return (char) (message[i] ^ (i < baseline.size() ? baseline[i] : 0)); };
+
+	appendVarint(data, numBytes);
+	std::size_t i = 0;
+	while (i < numBytes)
+	{
+		auto unchangedStart = i;
+		while (i < numBytes && changed(i) == 0)
+			++i;
+		// Unchanged bytes at the end don't need to be sent.
+		if (i == numBytes)
+			break;
+
+		auto changedStart = i;
+		while (i < numBytes)
+		{
+			auto runEnd = i;
+			while (runEnd < numBytes && changed(runEnd) == 0)
+				++runEnd;
+			if (runEnd == i)
+			{
+				++i;
+				continue;
+			}
+			if (runEnd - i >= MIN_UNCHANGED_RUN || runEnd == numBytes)
+				break;
+			i = runEnd;
+		}
+
+		appendVarint(data, changedStart - unchangedStart);
+		appendVarint(data, i - changedStart);
+		for (auto j = changedStart; j < i; ++j)
+			data.push_back(changed(j));
+	}
+}
+
+// Throws if the delta is malformed or the message would exceed maxMessageSize bytes.
+inline std::vector<char> decodeDelta(const std::string & baseline,
+                                     const char * pos,
+                                     const char * end,
+                                     std::size_t maxMessageSize)
+{
+	auto numBytes = readVarint(pos, end);
+	if (numBytes > maxMessageSize)
+		throw std::runtime_error{"asionet::delta: invalid delta."};
+
+	std::vector<char> message(baseline.begin(), baseline.begin() + std::min<std::size_t>(baseline.size(), numBytes));
+	message.resize(numBytes, 0);
+
+	std::size_t i = 0;
+	while (pos != end)
+	{
+		i += readVarint(pos, end);
+		auto numChanged = readVarint(pos, end);
+		if (numChanged > (std::size_t) (end - pos) || i > numBytes || numChanged > numBytes - i)
+			throw std::runtime_error{"asionet::delta: invalid delta."};
+
+		for (std::size_t j = 0; j < numChanged; ++j)
+			message[i++] ^= *pos++;
+	}
+	return message;
+}
+
+}
+}
+
+/**
+ * Sends messages like a DatagramSender but only transmits the bytes which changed since the last keyframe.
+ * This suits the pattern of periodically broadcasting a state which changes little between updates.
+ * Every keyframeInterval-th message is sent in full as a keyframe which the following deltas refer to.
+ * Since deltas don't depend on each other, a lost delta only loses its own update and a lost keyframe is recovered
+ * by the next one. The receiving side has to use a DeltaDatagramReceiver.
+ * The baseline is shared by all endpoints, so all receivers should get all messages (e.g. via broadcast).
+ */
+template<typename Message>
+class DeltaDatagramSender
+{
+public:
+	using SendHandler = typename DatagramSender<Message>::SendHandler;
+	using Endpoint = typename DatagramSender<Message>::Endpoint;
+
+	explicit DeltaDatagramSender(asionet::Context & context, std::size_t keyframeInterval = 30)
+		: context(context)
+		  , sender(context)
+		  , keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1)
+	{}
+
+	void asyncSend(const Message & message,
+	               const std::string & ip,
+	               std::uint16_t port,
+	               time::Duration timeout,
+	               SendHandler handler)
+	{
+		asyncSend(message, Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler);
+	}
+
+	void asyncSend(const Message & message,
+	               Endpoint endpoint,
+	               time::Duration timeout,
+	               SendHandler handler)
+	{
+		auto encoded = message::internal::acquireEncodeBuffer();
+		if (!message::internal::encode(message, *encoded))
+		{
+			context.post(
+				[handler] { handler(error::encoding); });
+			return;
+		}
+
+		auto data = message::internal::acquireEncodeBuffer();
+		// The datagram is queued before the lock is released, so a delta never overtakes the keyframe it refers to.
+		std::lock_guard<std::mutex> lock{mutex};
+		makeDatagram(*encoded, *data);
+		sender.asyncSend(std::shared_ptr<const std::string>{std::move(data)}, endpoint, timeout, std::move(handler));
+	}
+
+	// Sends the next message as keyframe, e.g. when a new receiver joins.
+	void forceKeyframe()
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		numMessagesSinceKeyframe = 0;
+	}
+
+	void cancel()
+	{
+		sender.cancel();
+	}
+
+	void enableChecksum(bool enabled = true)
+	{
+		sender.enableChecksum(enabled);
+	}
+
+private:
+	asionet::Context & context;
+	DatagramSender<Message> sender;
+	std::size_t keyframeInterval;
+	std::mutex mutex;
+	std::string baseline;
+	std::uint32_t keyframeId{0};
+	std::size_t numMessagesSinceKeyframe{0};
+
+	// The mutex must be held.
+	void makeDatagram(const std::string & encoded, std::string & data)
+	{
+		using namespace delta::internal;
+		data.resize(HEADER_SIZE);
+
+		if (numMessagesSinceKeyframe == 0)
+		{
+			baseline = encoded;
+			++keyframeId;
+			data[0] = KEYFRAME;
+			data.append(encoded);
+		}
+		else
+		{
+			data[0] = DELTA;
+			encodeDelta(baseline, encoded, data);
+			if (data.size() >= HEADER_SIZE + encoded.size())
+			{
+				data.resize(HEADER_SIZE);
+				data[0] = FULL;
+				data.append(encoded);
+			}
+		}
+		utils::toBigEndian<4>((std::uint8_t *) &data[1], keyframeId);
+		numMessagesSinceKeyframe = (numMessagesSinceKeyframe + 1) % keyframeInterval;
+	}
+};
+
+/**
+ * Receives messages which are sent by a DeltaDatagramSender. It keeps the last keyframe of each sender as baseline.
+ * A delta whose keyframe has not been received is reported with error::missingBaseline.
+ * At most maxSenders baselines are kept. If a keyframe of another sender arrives, the baseline which has been used
+ * least recently is dropped, so senders which went away don't pin their baselines forever.
+ */
+template<typename Message>
+class DeltaDatagramReceiver
+{
+public:
+	using Endpoint = typename DatagramReceiver<Message>::Endpoint;
+	using ReceiveHandler = typename DatagramReceiver<Message>::ReceiveHandler;
+
+	DeltaDatagramReceiver(asionet::Context & context,
+	                      std::uint16_t bindingPort,
+	                      std::size_t maxMessageSize = 512,
+	                      std::size_t maxSenders = 256)
+		: receiver(context, bindingPort, maxMessageSize + delta::internal::HEADER_SIZE)
+		  , maxMessageSize(maxMessageSize)
+		  , maxSenders(maxSenders > 0 ? maxSenders : 1)
+	{}
+
+	void asyncReceive(time::Duration timeout, ReceiveHandler handler)
+	{
+		receiver.asyncReceiveRaw(
+			timeout,
+			[this, handler = std::move(handler)](const auto & error, const auto & rawMessage, const auto & senderEndpoint)
+			{
+				Message message;
+				if (error)
+				{
+					handler(error, message, senderEndpoint);
+					return;
+				}
+				auto result = this->decode(rawMessage, senderEndpoint, message);
+				handler(result, message, senderEndpoint);
+			});
+	}
+
+	void cancel()
+	{
+		receiver.cancel();
+	}
+
+private:
+	struct Baseline
+	{
+		std::uint32_t keyframeId;
+		std::string bytes;
+		// Counts the received keyframes and deltas, so the least recently used baseline can be found.
+		std::uint64_t lastUse;
+	};
+
+	DatagramReceiver<Message> receiver;
+	std::size_t maxMessageSize;
+	std::size_t maxSenders;
+	std::mutex mutex;
+	std::map<Endpoint, Baseline> baselines;
+	std::uint64_t numUses{0};
+
+	// The mutex must be held.
+	Baseline & baselineOf(const Endpoint & senderEndpoint)
+	{
+		auto baseline = baselines.find(senderEndpoint);
+		if (baseline != baselines.end())
+			return baseline->second;
+
+		if (baselines.size() >= maxSenders)
+		{
+			auto leastRecentlyUsed = std::min_element(
+				baselines.begin(), baselines.end(),
+				[](const auto & lhs, const auto & rhs) { return lhs.second.lastUse < rhs.second.lastUse; });
+			baselines.erase(leastRecentlyUsed);
+		}
+		return baselines[senderEndpoint];
+	}
+
+	template<typename ConstBuffer>
+	error::Error decode(const ConstBuffer & buffer, const Endpoint & senderEndpoint, Message & message)
+	{
+		using namespace delta::internal;
+		if (buffer.size() < HEADER_SIZE)
+			return error::decoding;
+
+		auto kind = (std::uint8_t) buffer[0];
+		auto keyframeId = utils::fromBigEndian<4, std::uint32_t>((const std::uint8_t *) buffer.data() + 1);
+		asionet::internal::ConstBufferView<ConstBuffer> payload{buffer, buffer.size() - HEADER_SIZE, HEADER_SIZE};
+
+		if (kind == KEYFRAME)
+		{
+			{
+				std::lock_guard<std::mutex> lock{mutex};
+				auto & baseline = baselineOf(senderEndpoint);
+				baseline.keyframeId = keyframeId;
+				baseline.lastUse = ++numUses;
+				baseline.bytes.assign(payload.data(), payload.size());
+			}
+			return message::internal::decode(payload, message) ? error::success : error::decoding;
+		}
+
+		if (kind == FULL)
+			return message::internal::decode(payload, message) ? error::success : error::decoding;
+
+		if (kind != DELTA)
+			return error::decoding;
+
+		std::vector<char> bytes;
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			auto baseline = baselines.find(senderEndpoint);
+			if (baseline == baselines.end() || baseline->second.keyframeId != keyframeId)
+				return error::missingBaseline;
+
+			baseline->second.lastUse = ++numUses;
+
+			try
+			{
+				bytes = decodeDelta(
+					baseline->second.bytes, payload.data(), payload.data() + payload.size(), maxMessageSize);
+			}
+			catch (...)
+			{
+				return error::decoding;
+			}
+		}
+
+		auto numBytes = bytes.size();
+		SharedBytes decodedBytes{std::make_shared<const std::vector<char>>(std::move(bytes)), 0, numBytes};
+		return message::internal::decode(decodedBytes, message) ? error::success : error::decoding;
+	}
+};
+
+}
+
+#endif //ASIONET_DELTADATAGRAM_H
@@ -71,6 +71,10 @@ const Error decoding{codes::decoding};
 namespace codes { constexpr ErrorCode invalidFrame{5}; }
 const Error invalidFrame{codes::invalidFrame};
 
+// A delta message arrived whose baseline has not been received (see DeltaDatagramReceiver).
+namespace codes { constexpr ErrorCode missingBaseline{6}; }
+const Error missingBaseline{codes::missingBaseline};
+
 }
 }
 
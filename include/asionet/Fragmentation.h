@@ -0,0 +1,251 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_FRAGMENTATION_H
+#define ASIONET_FRAGMENTATION_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio/ip/udp.hpp>
+#include "Frame.h"
+#include "ObjectPool.h"
+#include "Time.h"
+#include "Utils.h"
+
+namespace asionet
+{
+namespace fragment
+{
+namespace internal
+{
+
+/**
+ * A message which doesn't fit into a single datagram is split into fragments which are sent as separate datagrams.
+ * Their frame header has Frame::FRAGMENT_FLAG set and their data starts with a fragment header: the 4 byte id of the
+ * message, the 2 byte index of the fragment and the 2 byte number of fragments of the message (all big-endian).
+ * The rest of the data is a chunk of the encoded message. All chunks of a message have the same size except for the
+ * last one which may be shorter.
+ */
+constexpr std::size_t HEADER_SIZE = 8;
+constexpr std::size_t MAX_FRAGMENTS = 0xffff;
+
+struct Fragment
+{
+	std::uint32_t messageId;
+	std::uint16_t index;
+	std::uint16_t numFragments;
+	const char * data;
+	std::size_t numBytes;
+};
+
+inline bool isFragment(const char * datagram, std::size_t numBytes)
+{
+	using asionet::internal::Frame;
+	return numBytes >= Frame::HEADER_SIZE &&
+	       (utils::fromBigEndian<4, std::uint32_t>((const std::uint8_t *) datagram) & Frame::FRAGMENT_FLAG) != 0;
+}
+
+// Validates the frame of a fragment datagram and parses its fragment header. Returns false if either is invalid.
+inline bool parseFragment(const char * datagram, std::size_t numBytes, Fragment & fragment)
+{
+	using asionet::internal::Frame;
+
+	if (numBytes < Frame::HEADER_SIZE)
+		return false;
+
+	auto bytes = (const std::uint8_t *) datagram;
+	auto value = utils::fromBigEndian<4, std::uint32_t>(bytes);
+	auto hasChecksum = (value & Frame::CHECKSUM_FLAG) != 0;
+	std::size_t numDataBytes = value & ~(Frame::CHECKSUM_FLAG | Frame::FRAGMENT_FLAG);
+	if (numBytes < Frame::HEADER_SIZE + numDataBytes + (hasChecksum ? Frame::CHECKSUM_SIZE : 0))
+		return false;
+
+	auto data = bytes + Frame::HEADER_SIZE;
+	if (hasChecksum && !Frame::verifyChecksum(data, numDataBytes, data + numDataBytes))
+		return false;
+
+	if (numDataBytes <= HEADER_SIZE)
+		return false;
+
+	fragment.messageId = utils::fromBigEndian<4, std::uint32_t>(data);
+	fragment.index = utils::fromBigEndian<2, std::uint16_t>(data + 4);
+	fragment.numFragments = utils::fromBigEndian<2, std::uint16_t>(data + 6);
+	fragment.data = (const char *) data + HEADER_SIZE;
+	fragment.numBytes = numDataBytes - HEADER_SIZE;
+	return fragment.index < fragment.numFragments;
+}
+
+// Splits the encoded message into the data of fragments which are at most maxDataSize bytes each.
+// Returns no fragments if the message would need more than MAX_FRAGMENTS of them.
+inline std::vector<std::shared_ptr<const std::string>> split(const std::string & message,
+                                                             std::size_t maxDataSize,
+                                                             std::uint32_t messageId)
+{
+	auto chunkSize = maxDataSize - HEADER_SIZE;
+	auto numFragments = (message.size() + chunkSize - 1) / chunkSize;
+	std::vector<std::shared_ptr<const std::string>> fragments;
+	if (numFragments > MAX_FRAGMENTS)
+		return fragments;
+
+	fragments.reserve(numFragments);
+	for (std::size_t i = 0; i < numFragments; ++i)
+	{
+		auto offset = i * chunkSize;
+		auto numBytes = std::min(chunkSize, message.size() - offset);
+		std::uint8_t header[HEADER_SIZE];
+		utils::toBigEndian<4>(header, messageId);
+		utils::toBigEndian<2>(header + 4, (std::uint16_t) i);
+		utils::toBigEndian<2>(header + 6, (std::uint16_t) numFragments);
+
+		auto fragment = std::make_shared<std::string>();
+		fragment->reserve(HEADER_SIZE + numBytes);
+		fragment->append((const char *) header, HEADER_SIZE);
+		fragment->append(message, offset, numBytes);
+		fragments.push_back(std::move(fragment));
+	}
+	return fragments;
+}
+
+/**
+ * Collects fragments until all fragments of a message have arrived. Messages are identified by their sender and id,
+ * so fragments of different messages may arrive interleaved and in any order. Duplicate fragments are ignored.
+ * A message whose fragments didn't all arrive within the timeout (counted from its first fragment) is dropped.
+ * If the buffered fragments would exceed maxMemory bytes, the oldest incomplete messages are dropped to make room.
+ * Not thread-safe.
+ */
+class Reassembler
+{
+public:
+	using Endpoint = boost::asio::ip::udp::endpoint;
+	using BufferPool = utils::ObjectPool<std::vector<char>>;
+
+	Reassembler(time::Duration timeout, std::size_t maxMemory, BufferPool & bufferPool)
+		: timeout(timeout)
+		  , maxMemory(maxMemory)
+		  , bufferPool(bufferPool)
+	{}
+
+	// Returns the reassembled message once its last missing fragment has been added and nullptr otherwise.
+	std::shared_ptr<std::vector<char>> add(const Endpoint & sender, const Fragment & fragment)
+	{
+		auto now = time::now();
+		while (!arrivals.empty() && arrivals.front().first + timeout <= now)
+			dropOldest();
+
+		// A message which can't fit into memory is dropped right away instead of making room for it first.
+		auto isLast = fragment.index + 1 == fragment.numFragments;
+		auto minMessageSize = isLast ? fragment.numBytes : fragment.numBytes * (fragment.numFragments - 1);
+		if (minMessageSize > maxMemory)
+			return nullptr;
+
+		while (numBufferedBytes + fragment.numBytes > maxMemory && !arrivals.empty())
+			dropOldest();
+
+		Key key{sender, fragment.messageId};
+		auto it = messages.find(key);
+		if (it == messages.end())
+		{
+			it = messages.emplace(key, PartialMessage{now, fragment.numFragments}).first;
+			arrivals.emplace_back(now, key);
+		}
+
+		auto & message = it->second;
+		if (message.numFragments != fragment.numFragments || message.chunks.count(fragment.index) != 0)
+			return nullptr;
+
+		message.chunks.emplace(fragment.index, std::string{fragment.data, fragment.numBytes});
+		message.numBytes += fragment.numBytes;
+		numBufferedBytes += fragment.numBytes;
+		if (message.chunks.size() < message.numFragments)
+			return nullptr;
+
+		auto result = bufferPool.acquire();
+		result->clear();
+		result->reserve(message.numBytes);
+		for (const auto & messageChunk : message.chunks)
+			result->insert(result->end(), messageChunk.second.begin(), messageChunk.second.end());
+
+		numBufferedBytes -= message.numBytes;
+		messages.erase(it);
+		return result;
+	}
+
+	std::size_t getNumBufferedBytes() const
+	{
+		return numBufferedBytes;
+	}
+
+	// Number of messages which still wait for some of their fragments.
+	std::size_t getNumIncomplete() const
+	{
+		return messages.size();
+	}
+
+private:
+	using Key = std::pair<Endpoint, std::uint32_t>;
+
+	struct PartialMessage
+	{
+		PartialMessage(time::TimePoint firstArrival, std::size_t numFragments)
+			: firstArrival(firstArrival)
+			  , numFragments(numFragments)
+		{}
+
+		time::TimePoint firstArrival;
+		std::size_t numFragments;
+		// The chunks by their fragment index. They're only stored once they have arrived since a message may announce
+		// many more fragments than fit into maxMemory.
+		std::map<std::uint16_t, std::string> chunks;
+		std::size_t numBytes{0};
+	};
+
+	time::Duration timeout;
+	std::size_t maxMemory;
+	BufferPool & bufferPool;
+	std::map<Key, PartialMessage> messages;
+	// The first arrival of each message, oldest first. Completed messages are only removed once they reach the front.
+	std::deque<std::pair<time::TimePoint, Key>> arrivals;
+	std::size_t numBufferedBytes{0};
+
+	void dropOldest()
+	{
+		const auto & arrival = arrivals.front();
+		auto it = messages.find(arrival.second);
+		// The message may have been completed in the meantime and its id may even have been reused since then.
+		if (it != messages.end() && it->second.firstArrival == arrival.first)
+		{
+			numBufferedBytes -= it->second.numBytes;
+			messages.erase(it);
+		}
+		arrivals.pop_front();
+	}
+};
+
+}
+}
+}
+
+#endif //ASIONET_FRAGMENTATION_H
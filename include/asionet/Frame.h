@@ -24,24 +24,42 @@
 #ifndef ASIONET_FRAME_H
 #define ASIONET_FRAME_H
 
+#include <array>
 #include <cstdint>
 #include <boost/asio/buffer.hpp>
 #include "Utils.h"
+#include "Crc32c.h"
 
 namespace asionet
 {
 namespace internal
 {
 
+/**
+ * A frame consists of a 4 byte header, the data bytes and an optional 4 byte CRC-32C trailer.
+ * The header stores the number of data bytes in big-endian byte order. Its most significant bit is set if the frame
+ * carries a checksum trailer. Thus, receivers verify checksums automatically whereas senders have to opt in.
+ * The second most significant bit marks a datagram which only carries a fragment of a larger message (see
+ * Fragmentation.h). Since datagrams are far smaller than 1 GiB, the bit is never part of a datagram's size.
+ * Receivers which don't reassemble fragments reject them as invalid frames.
+ * Since the flags share the header with the size, senders fail data of more than MAX_DATA_SIZE bytes with
+ * error::encoding instead of sending a malformed frame.
+ */
 class Frame
 {
 public:
     static constexpr std::size_t HEADER_SIZE = 4;
+    static constexpr std::size_t CHECKSUM_SIZE = 4;
+    static constexpr std::uint32_t CHECKSUM_FLAG = 0x80000000;
+    static constexpr std::uint32_t FRAGMENT_FLAG = 0x40000000;
+    static constexpr std::uint32_t MAX_DATA_SIZE = 0x7fffffff;
 
-    Frame(const std::uint8_t * data, std::uint32_t numDataBytes)
-        : data(data), numDataBytes(numDataBytes)
+    Frame(const std::uint8_t * data, std::uint32_t numDataBytes, bool checksum = false, std::uint32_t flags = 0)
+        : numDataBytes(numDataBytes), data(data), checksum(checksum)
     {
-        utils::toBigEndian<4>(header, numDataBytes);
+        utils::toBigEndian<4>(header, (checksum ? (numDataBytes | CHECKSUM_FLAG) : numDataBytes) | flags);
+        if (checksum)
+            utils::toBigEndian<4>(trailer, utils::crc32c(data, numDataBytes));
     }
 
     Frame(const Frame &) = delete;
@@ -54,20 +72,51 @@ public:
 
     auto getBuffers() const
     {
-        return std::vector<boost::asio::const_buffer>{
-            boost::asio::buffer((const void *) header, sizeof(header)),
-            boost::asio::buffer((const void *) data, numDataBytes)};
+        std::vector<boost::asio::const_buffer> buffers;
+        appendBuffers(buffers);
+        return buffers;
+    }
+
+    // Like getBuffers() but without allocating. The trailer's buffer is empty if the frame has no checksum.
+    std::array<boost::asio::const_buffer, 3> getBufferArray() const
+    {
+        return {boost::asio::buffer((const void *) header, sizeof(header)),
+                boost::asio::buffer((const void *) data, numDataBytes),
+                boost::asio::buffer((const void *) trailer, checksum ? sizeof(trailer) : 0)};
+    }
+
+    void appendBuffers(std::vector<boost::asio::const_buffer> & buffers) const
+    {
+        buffers.push_back(boost::asio::buffer((const void *) header, sizeof(header)));
+        buffers.push_back(boost::asio::buffer((const void *) data, numDataBytes));
+        if (checksum)
+            buffers.push_back(boost::asio::buffer((const void *) trailer, sizeof(trailer)));
     }
 
     std::size_t getSize() const
     {
-        return sizeof(header) + numDataBytes;
+        return sizeof(header) + numDataBytes + (checksum ? sizeof(trailer) : 0);
+    }
+
+    // Parses a frame header. Returns the number of data bytes and whether a checksum trailer follows the data.
+    static std::uint32_t parseHeader(const std::uint8_t * header, bool & hasChecksum)
+    {
+        auto value = utils::fromBigEndian<4, std::uint32_t>(header);
+        hasChecksum = (value & CHECKSUM_FLAG) != 0;
+        return value & MAX_DATA_SIZE;
+    }
+
+    static bool verifyChecksum(const std::uint8_t * data, std::size_t numDataBytes, const std::uint8_t * trailer)
+    {
+        return utils::crc32c(data, numDataBytes) == utils::fromBigEndian<4, std::uint32_t>(trailer);
     }
 
 private:
     std::uint32_t numDataBytes;
     std::uint8_t header[4];
+    std::uint8_t trailer[4];
     const std::uint8_t * data;
+    bool checksum;
 };
 
 }
@@ -31,6 +31,9 @@
 #include <boost/asio/read.hpp>
 #include "Stream.h"
 #include "Socket.h"
+#include "WriteQueue.h"
+#include "SharedBytes.h"
+#include "ObjectPool.h"
 #include <boost/algorithm/string/replace.hpp>
 
 namespace asionet
@@ -51,7 +54,7 @@ using ReceiveFromHandler = std::function<
 	     Message & message,
 	     const boost::asio::ip::udp::endpoint & endpoint)>;
 
-template<typename Message>
+template<typename Message, typename Enable = void>
 struct Encoder;
 
 template<>
@@ -59,9 +62,12 @@ struct Encoder<std::string>
 {
 	void operator()(const std::string & message, std::string & data) const
 	{ data = message; }
+
+	void append(const std::string & message, std::string & data) const
+	{ data.append(message); }
 };
 
-template<typename Message>
+template<typename Message, typename Enable = void>
 struct Decoder;
 
 template<>
@@ -69,12 +75,121 @@ struct Decoder<std::string>
 {
 	template<typename ConstBuffer>
 	void operator()(const ConstBuffer & buffer, std::string & message) const
-	{ message = std::string{buffer.begin(), buffer.end()}; }
+	{ message.assign(buffer.data(), buffer.size()); }
+};
+
+template<>
+struct Encoder<SharedBytes>
+{
+	void operator()(const SharedBytes & message, std::string & data) const
+	{ data.assign(message.data(), message.size()); }
+
+	void append(const SharedBytes & message, std::string & data) const
+	{ data.append(message.data(), message.size()); }
+};
+
+// Takes over the receive buffer without copying if the receive path supports it (e.g. DatagramReceiver).
+template<>
+struct Decoder<SharedBytes>
+{
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & buffer, SharedBytes & message) const
+	{ message = buffer.share(); }
 };
 
+// Decodes a message from a sequence of chunks which is received by asyncReceiveChunked().
+// The call operator is invoked for each chunk in order of arrival.
+template<typename Message>
+struct IncrementalDecoder;
+
+template<>
+struct IncrementalDecoder<std::string>
+{
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & chunk, std::string & message) const
+	{ message.append(chunk.data(), chunk.size()); }
+};
+
+using ProgressHandler = std::function<void(std::uint64_t numBytesReceived)>;
+
+// Like ProgressHandler, but the next chunk is not received before 'resume' has been called (see
+// asyncReceiveChunkedPausable()), so the receiver can throttle the transfer.
+using PausableProgressHandler = std::function<void(std::uint64_t numBytesReceived,
+                                                   const stream::ResumeHandler & resume)>;
+
 namespace internal
 {
 
+constexpr std::size_t MAX_POOLED_ENCODE_BUFFERS = 64;
+constexpr std::size_t MAX_POOLED_ENCODE_BUFFER_CAPACITY = 0x100000;
+
+/**
+ * Recycles the strings which messages are encoded into, so their capacity is kept between sends.
+ * A buffer returns to the pool as soon as its send operation has completed.
+ * Buffers which grew larger than MAX_POOLED_ENCODE_BUFFER_CAPACITY are shrunk, so a single huge message doesn't
+ * pin its memory forever.
+ */
+class EncodeBufferPool : public utils::ObjectPool<std::string>
+{
+public:
+	EncodeBufferPool()
+		: utils::ObjectPool<std::string>(MAX_POOLED_ENCODE_BUFFERS, &recycle)
+	{}
+
+private:
+	static void recycle(std::string & data)
+	{
+		data.clear();
+		if (data.capacity() > MAX_POOLED_ENCODE_BUFFER_CAPACITY)
+			data.shrink_to_fit();
+	}
+};
+
+// Used by the free send functions which have no object to hold a pool.
+inline std::shared_ptr<std::string> acquireEncodeBuffer()
+{
+	thread_local EncodeBufferPool pool;
+	return pool.acquire();
+}
+
+// Pre-encoded bytes which are sent as they are instead of being encoded as a message (see asyncSend()).
+template<typename Message>
+struct IsEncodedData : std::false_type {};
+
+template<>
+struct IsEncodedData<std::shared_ptr<std::string>> : std::true_type {};
+
+template<>
+struct IsEncodedData<std::shared_ptr<const std::string>> : std::true_type {};
+
+template<typename Message>
+using EnableIfNotEncodedData = std::enable_if_t<!IsEncodedData<Message>::value>;
+
+// An Encoder may provide append(message, data) which encodes the message behind the bytes already in data.
+template<typename Message, typename = void>
+struct HasAppendingEncoder : std::false_type {};
+
+template<typename Message>
+struct HasAppendingEncoder<
+	Message,
+	decltype(Encoder<Message>{}.append(std::declval<const Message &>(), std::declval<std::string &>()))>
+	: std::true_type {};
+
+template<typename Message>
+std::enable_if_t<HasAppendingEncoder<Message>::value> encodeAppending(const Message & message, std::string & data)
+{
+	Encoder<Message>{}.append(message, data);
+}
+
+// Other encoders overwrite their output, so we encode into a scratch buffer which keeps its capacity.
+template<typename Message>
+std::enable_if_t<!HasAppendingEncoder<Message>::value> encodeAppending(const Message & message, std::string & data)
+{
+	thread_local std::string scratch;
+	Encoder<Message>{}(message, scratch);
+	data.append(scratch);
+}
+
 template<typename Message>
 bool encode(const Message & message, std::string & data)
 {
@@ -105,13 +220,114 @@ bool decode(const ConstBuffer & buffer, Message & message)
 
 }
 
-template<typename Message, typename SyncWriteStream>
+/**
+ * A received message which has not been decoded yet.
+ * It provides the ConstBuffer interface to inspect the encoded bytes, so routers or filters may look at a few header
+ * bytes or forward the message without paying for a full decode. Call decode() to run Decoder<Message> on demand.
+ * A RawMessage is a view of the receive buffer and therefore only valid during the handler call.
+ * Use share() to keep the bytes any longer.
+ */
+template<typename Message>
+class RawMessage
+{
+public:
+	using ConstIterator = const char *;
+
+	template<typename ConstBuffer>
+	explicit RawMessage(const ConstBuffer & buffer)
+		: buffer(&buffer)
+		  , bytes(buffer.data())
+		  , numBytes(buffer.size())
+		  , shareFunction(&shareBuffer<ConstBuffer>)
+	{}
+
+	char operator[](std::size_t pos) const
+	{ return bytes[pos]; }
+
+	const char * data() const
+	{ return bytes; }
+
+	std::size_t size() const
+	{ return numBytes; }
+
+	ConstIterator begin() const
+	{ return bytes; }
+
+	ConstIterator end() const
+	{ return bytes + numBytes; }
+
+	SharedBytes share() const
+	{ return shareFunction(buffer); }
+
+	// Returns false if the decoder failed.
+	bool decode(Message & message) const
+	{ return internal::decode(*this, message); }
+
+private:
+	const void * buffer;
+	const char * bytes;
+	std::size_t numBytes;
+	SharedBytes (* shareFunction)(const void *);
+
+	template<typename ConstBuffer>
+	static SharedBytes shareBuffer(const void * buffer)
+	{ return static_cast<const ConstBuffer *>(buffer)->share(); }
+};
+
+template<typename Message>
+using RawReceiveHandler = std::function<void(const error::Error & code, const RawMessage<Message> & message)>;
+
+template<typename Message>
+using RawReceiveFromHandler = std::function<
+	void(const error::Error & code,
+	     const RawMessage<Message> & message,
+	     const boost::asio::ip::udp::endpoint & endpoint)>;
+
+/**
+ * Sends bytes which already hold an encoded message, e.g. a large std::string message or a message which is sent to
+ * many receivers. The bytes are written directly from the given string without being encoded (and thus copied).
+ * The string is kept alive until the handler has been called and must not be modified in the meantime.
+ */
+template<typename SyncWriteStream>
+void asyncSend(SyncWriteStream & stream,
+               std::shared_ptr<const std::string> data,
+               const time::Duration & timeout,
+               SendHandler handler,
+               bool checksum = false)
+{
+	// keep reference because of std::move()
+	auto & dataRef = *data;
+
+	asionet::stream::asyncWrite(
+		stream, dataRef, timeout,
+		[handler = std::move(handler), data = std::move(data)](const auto & errorCode) { handler(errorCode); },
+		checksum);
+};
+
+template<typename SyncWriteStream>
+void asyncSend(stream::WriteQueue<SyncWriteStream> & writeQueue,
+               std::shared_ptr<const std::string> data,
+               const time::Duration & timeout,
+               SendHandler handler,
+               bool checksum = false)
+{
+	// keep reference because of std::move()
+	auto & dataRef = *data;
+
+	writeQueue.asyncWrite(
+		dataRef, timeout,
+		[handler = std::move(handler), data = std::move(data)](const auto & errorCode) { handler(errorCode); },
+		checksum);
+};
+
+template<typename Message, typename SyncWriteStream, typename = internal::EnableIfNotEncodedData<Message>>
 void asyncSend(SyncWriteStream & stream,
                const Message & message,
                const time::Duration & timeout,
-               SendHandler handler)
+               SendHandler handler,
+               bool checksum = false)
 {
-	auto data = std::make_shared<std::string>();
+	auto data = internal::acquireEncodeBuffer();
 	if (!internal::encode(message, *data))
 	{
 		stream.get_executor().context().post(
@@ -119,12 +335,25 @@ void asyncSend(SyncWriteStream & stream,
 		return;
 	}
 
-	// keep reference because of std::move()
-	auto & dataRef = *data;
+	asyncSend(stream, std::shared_ptr<const std::string>{std::move(data)}, timeout, std::move(handler), checksum);
+};
 
-	asionet::stream::asyncWrite(
-		stream, dataRef, timeout,
-		[handler = std::move(handler), data = std::move(data)](const auto & errorCode) { handler(errorCode); });
+template<typename Message, typename SyncWriteStream, typename = internal::EnableIfNotEncodedData<Message>>
+void asyncSend(stream::WriteQueue<SyncWriteStream> & writeQueue,
+               const Message & message,
+               const time::Duration & timeout,
+               SendHandler handler,
+               bool checksum = false)
+{
+	auto data = internal::acquireEncodeBuffer();
+	if (!internal::encode(message, *data))
+	{
+		writeQueue.getStream().get_executor().context().post(
+			[handler] { handler(error::encoding); });
+		return;
+	}
+
+	asyncSend(writeQueue, std::shared_ptr<const std::string>{std::move(data)}, timeout, std::move(handler), checksum);
 };
 
 template<typename Message, typename SyncReadStream>
@@ -147,26 +376,114 @@ void asyncReceive(SyncReadStream & stream,
 		});
 };
 
-template<typename Message, typename DatagramSocket>
+// Like asyncReceive() but leaves decoding to the handler.
+template<typename Message, typename SyncReadStream>
+void asyncReceiveRaw(SyncReadStream & stream,
+                     boost::asio::streambuf & buffer,
+                     const time::Duration & timeout,
+                     RawReceiveHandler<Message> handler)
+{
+	asionet::stream::asyncRead(
+		stream, buffer, timeout,
+		[handler = std::move(handler)](const auto & errorCode, const auto & constBuffer)
+		{
+			handler(errorCode, RawMessage<Message>{constBuffer});
+		});
+};
+
+// Like asyncReceiveChunked(), but the progressHandler resumes the transfer once the receiver is ready for the next
+// chunk.
+template<typename Message, typename SyncReadStream>
+void asyncReceiveChunkedPausable(SyncReadStream & stream,
+                                 boost::asio::streambuf & buffer,
+                                 const time::Duration & timeout,
+                                 ReceiveHandler<Message> handler,
+                                 PausableProgressHandler progressHandler)
+{
+	auto message = std::make_shared<Message>();
+	auto decodingFailed = std::make_shared<bool>(false);
+
+	asionet::stream::asyncReadChunkedPausable(
+		stream, buffer, timeout,
+		[message, decodingFailed, progressHandler = std::move(progressHandler)]
+			(const auto & chunk, auto numBytesReceived, const auto & resume)
+		{
+			try
+			{
+				IncrementalDecoder<Message>{}(chunk, *message);
+			}
+			catch (...)
+			{
+				*decodingFailed = true;
+				return false;
+			}
+
+			progressHandler(numBytesReceived, resume);
+			return true;
+		},
+		[handler = std::move(handler), message, decodingFailed](const auto & error, auto)
+		{
+			if (*decodingFailed)
+			{
+				handler(error::decoding, *message);
+				return;
+			}
+			handler(error, *message);
+		});
+}
+
+/**
+ * Receives a message which was sent by stream::asyncWriteChunked().
+ * Each chunk is passed to IncrementalDecoder<Message> as soon as it has arrived, so the size of the message is not
+ * limited by the size of the buffer. The optional progressHandler is called after each chunk.
+ */
+template<typename Message, typename SyncReadStream>
+void asyncReceiveChunked(SyncReadStream & stream,
+                         boost::asio::streambuf & buffer,
+                         const time::Duration & timeout,
+                         ReceiveHandler<Message> handler,
+                         ProgressHandler progressHandler = nullptr)
+{
+	asyncReceiveChunkedPausable<Message>(
+		stream, buffer, timeout, std::move(handler),
+		[progressHandler = std::move(progressHandler)](auto numBytesReceived, const auto & resume)
+		{
+			if (progressHandler)
+				progressHandler(numBytesReceived);
+			resume();
+		});
+}
+
+// Sends bytes which already hold an encoded message without copying them. See asyncSend().
+template<typename DatagramSocket, typename Endpoint>
 void asyncSendDatagram(DatagramSocket & socket,
-                       const Message & message,
-                       const std::string & ip,
-                       std::uint16_t port,
+                       std::shared_ptr<const std::string> data,
+                       const Endpoint & endpoint,
                        const time::Duration & timeout,
-                       SendToHandler handler)
+                       SendToHandler handler,
+                       bool checksum = false)
 {
-	using Endpoint = boost::asio::ip::udp::endpoint;
-	asyncSendDatagram(socket, message, Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler);
+	// keep reference because of std::move()
+	auto & dataRef = *data;
+
+	asionet::socket::asyncSendTo(
+		socket, dataRef, endpoint, timeout,
+		[handler = std::move(handler), data = std::move(data)](const auto & error) { handler(error); },
+		checksum);
 }
 
-template<typename Message, typename DatagramSocket, typename Endpoint>
+template<typename Message,
+	typename DatagramSocket,
+	typename Endpoint,
+	typename = internal::EnableIfNotEncodedData<Message>>
 void asyncSendDatagram(DatagramSocket & socket,
                        const Message & message,
                        const Endpoint & endpoint,
                        const time::Duration & timeout,
-                       SendToHandler handler)
+                       SendToHandler handler,
+                       bool checksum = false)
 {
-	auto data = std::make_shared<std::string>();
+	auto data = internal::acquireEncodeBuffer();
 	if (!internal::encode(message, *data))
 	{
 		socket.get_executor().context().post(
@@ -174,22 +491,49 @@ void asyncSendDatagram(DatagramSocket & socket,
 		return;
 	}
 
-	// keep reference because of std::move()
-	auto & dataRef = *data;
+	asyncSendDatagram(
+		socket, std::shared_ptr<const std::string>{std::move(data)}, endpoint, timeout, std::move(handler), checksum);
+}
 
-	asionet::socket::asyncSendTo(
-		socket, dataRef, endpoint, timeout,
-		[handler = std::move(handler), data = std::move(data)](const auto & error) { handler(error); });
+template<typename Message, typename DatagramSocket, typename = internal::EnableIfNotEncodedData<Message>>
+void asyncSendDatagram(DatagramSocket & socket,
+                       const Message & message,
+                       const std::string & ip,
+                       std::uint16_t port,
+                       const time::Duration & timeout,
+                       SendToHandler handler,
+                       bool checksum = false)
+{
+	using Endpoint = boost::asio::ip::udp::endpoint;
+	asyncSendDatagram(
+		socket, message, Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler, checksum);
 }
 
-template<typename Message, typename DatagramSocket>
+template<typename DatagramSocket>
+void asyncSendDatagram(DatagramSocket & socket,
+                       std::shared_ptr<const std::string> data,
+                       const std::string & ip,
+                       std::uint16_t port,
+                       const time::Duration & timeout,
+                       SendToHandler handler,
+                       bool checksum = false)
+{
+	using Endpoint = boost::asio::ip::udp::endpoint;
+	asyncSendDatagram(
+		socket, std::move(data), Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler, checksum);
+}
+
+namespace internal
+{
+
+template<typename Message, typename DatagramSocket, typename Buffer>
 void asyncReceiveDatagram(DatagramSocket & socket,
-                          std::vector<char> & buffer,
+                          Buffer && buffer,
                           const time::Duration & timeout,
                           ReceiveFromHandler<Message> handler)
 {
 	asionet::socket::asyncReceiveFrom(
-		socket, buffer, timeout,
+		socket, std::forward<Buffer>(buffer), timeout,
 		[handler = std::move(handler)](const auto & error, const auto & constBuffer, const auto & senderEndpoint)
 		{
 			Message message;
@@ -202,6 +546,40 @@ void asyncReceiveDatagram(DatagramSocket & socket,
 		});
 }
 
+template<typename Message, typename DatagramSocket, typename Buffer>
+void asyncReceiveDatagramRaw(DatagramSocket & socket,
+                             Buffer && buffer,
+                             const time::Duration & timeout,
+                             RawReceiveFromHandler<Message> handler)
+{
+	asionet::socket::asyncReceiveFrom(
+		socket, std::forward<Buffer>(buffer), timeout,
+		[handler = std::move(handler)](const auto & error, const auto & constBuffer, const auto & senderEndpoint)
+		{
+			handler(error, RawMessage<Message>{constBuffer}, senderEndpoint);
+		});
+}
+
+}
+
+template<typename Message, typename DatagramSocket>
+void asyncReceiveDatagram(DatagramSocket & socket,
+                          std::vector<char> & buffer,
+                          const time::Duration & timeout,
+                          ReceiveFromHandler<Message> handler)
+{
+	internal::asyncReceiveDatagram<Message>(socket, buffer, timeout, std::move(handler));
+}
+
+template<typename Message, typename DatagramSocket>
+void asyncReceiveDatagram(DatagramSocket & socket,
+                          std::shared_ptr<std::vector<char>> buffer,
+                          const time::Duration & timeout,
+                          ReceiveFromHandler<Message> handler)
+{
+	internal::asyncReceiveDatagram<Message>(socket, std::move(buffer), timeout, std::move(handler));
+}
+
 }
 }
 
@@ -0,0 +1,199 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_OBJECTPOOL_H
+#define ASIONET_OBJECTPOOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+namespace asionet
+{
+namespace utils
+{
+
+/**
+ * Thread-safe pool of recycled objects.
+ * acquire() returns a shared_ptr whose deleter hands the object back to the pool instead of destroying it.
+ * Therefore, an object may be passed around freely (e.g. moved into a message) and it's only recycled once its last
+ * owner has released it. Objects which are released after the pool has been destroyed or while the pool already
+ * holds maxPooledObjects objects are simply deleted.
+ * The optional recycle function is invoked on each object which goes back to the pool, e.g. to clear its contents.
+ * The control blocks of the returned shared_ptrs are recycled as well, so acquire() doesn't allocate at all once the
+ * pool has warmed up.
+ */
+template<typename T>
+class ObjectPool
+{
+public:
+	using Recycler = std::function<void(T & object)>;
+
+	explicit ObjectPool(std::size_t maxPooledObjects = 16, Recycler recycler = nullptr)
+		: storage(std::make_shared<Storage>(maxPooledObjects, std::move(recycler)))
+	{}
+
+	ObjectPool(const ObjectPool &) = delete;
+
+	ObjectPool & operator=(const ObjectPool &) = delete;
+
+	std::shared_ptr<T> acquire()
+	{
+		std::unique_ptr<T> object;
+		{
+			std::lock_guard<std::mutex> lock{storage->mutex};
+			if (!storage->objects.empty())
+			{
+				object = std::move(storage->objects.back());
+				storage->objects.pop_back();
+			}
+		}
+
+		if (!object)
+			object = std::make_unique<T>();
+
+		std::weak_ptr<Storage> weakStorage = storage;
+		return std::shared_ptr<T>(
+			object.release(),
+			[weakStorage](T * object) { release(weakStorage, object); },
+			ControlBlockAllocator<T>{weakStorage});
+	}
+
+	std::size_t getNumPooledObjects() const
+	{
+		std::lock_guard<std::mutex> lock{storage->mutex};
+		return storage->objects.size();
+	}
+
+private:
+	struct Storage
+	{
+		Storage(std::size_t maxPooledObjects, Recycler && recycler)
+			: maxPooledObjects(maxPooledObjects), recycler(std::move(recycler))
+		{}
+
+		~Storage()
+		{
+			for (auto block : blocks)
+				::operator delete(block);
+		}
+
+		// Returns nullptr if there's no free block of the given size.
+		void * allocateBlock(std::size_t size)
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			if (size != blockSize || blocks.empty())
+				return nullptr;
+
+			auto block = blocks.back();
+			blocks.pop_back();
+			return block;
+		}
+
+		// Returns false if the block isn't kept.
+		bool deallocateBlock(void * block, std::size_t size)
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			// All control blocks of a pool have the same type and thus the same size.
+			if (blockSize == 0)
+				blockSize = size;
+			if (size != blockSize || blocks.size() >= maxPooledObjects)
+				return false;
+
+			blocks.push_back(block);
+			return true;
+		}
+
+		std::mutex mutex;
+		std::vector<std::unique_ptr<T>> objects;
+		std::size_t maxPooledObjects;
+		Recycler recycler;
+		// Free control blocks of the shared_ptrs returned by acquire().
+		std::vector<void *> blocks;
+		std::size_t blockSize{0};
+	};
+
+	// Allocates the control blocks of the shared_ptrs returned by acquire() from the pool's free blocks.
+	template<typename U>
+	struct ControlBlockAllocator
+	{
+		using value_type = U;
+
+		explicit ControlBlockAllocator(std::weak_ptr<Storage> storage)
+			: storage(std::move(storage))
+		{}
+
+		template<typename V>
+		ControlBlockAllocator(const ControlBlockAllocator<V> & other)
+			: storage(other.storage)
+		{}
+
+		U * allocate(std::size_t n)
+		{
+			auto lockedStorage = storage.lock();
+			auto block = lockedStorage ? lockedStorage->allocateBlock(n * sizeof(U)) : nullptr;
+			return static_cast<U *>(block ? block : ::operator new(n * sizeof(U)));
+		}
+
+		void deallocate(U * block, std::size_t n)
+		{
+			auto lockedStorage = storage.lock();
+			if (!lockedStorage || !lockedStorage->deallocateBlock(block, n * sizeof(U)))
+				::operator delete(block);
+		}
+
+		// Blocks are interchangeable between pools.
+		template<typename V>
+		bool operator==(const ControlBlockAllocator<V> &) const
+		{ return true; }
+
+		template<typename V>
+		bool operator!=(const ControlBlockAllocator<V> &) const
+		{ return false; }
+
+		std::weak_ptr<Storage> storage;
+	};
+
+	std::shared_ptr<Storage> storage;
+
+	static void release(const std::weak_ptr<Storage> & weakStorage, T * rawObject)
+	{
+		std::unique_ptr<T> object{rawObject};
+		auto storage = weakStorage.lock();
+		if (!storage)
+			return;
+
+		if (storage->recycler)
+			storage->recycler(*object);
+
+		std::lock_guard<std::mutex> lock{storage->mutex};
+		if (storage->objects.size() < storage->maxPooledObjects)
+			storage->objects.push_back(std::move(object));
+	}
+};
+
+}
+}
+
+#endif //ASIONET_OBJECTPOOL_H
@@ -65,9 +65,8 @@ public:
 		if (!sendData)
 			return;
 
-		auto asyncOperation = [this](auto && ... args)
-		{ this->asyncCallOperation(std::forward<decltype(args)>(args)...); };
-		operationManager.startOperation(asyncOperation, sendData, host, port, timeout, handler);
+		asyncCall(
+			std::shared_ptr<const std::string>{std::move(sendData)}, std::move(host), port, timeout, std::move(handler));
 	}
 
 	void asyncCall(const RequestMessage & request,
@@ -79,9 +78,31 @@ public:
 		if (!sendData)
 			return;
 
+		asyncCall(
+			std::shared_ptr<const std::string>{std::move(sendData)}, endpointIterator, timeout, std::move(handler));
+	}
+
+	// Sends bytes which already hold an encoded request without copying them.
+	// The string is kept alive until the handler has been called and must not be modified in the meantime.
+	void asyncCall(std::shared_ptr<const std::string> encodedRequest,
+	               std::string host,
+	               std::uint16_t port,
+	               time::Duration timeout,
+	               CallHandler handler)
+	{
+		auto asyncOperation = [this](auto && ... args)
+		{ this->asyncCallOperation(std::forward<decltype(args)>(args)...); };
+		operationManager.startOperation(asyncOperation, encodedRequest, host, port, timeout, handler);
+	}
+
+	void asyncCall(std::shared_ptr<const std::string> encodedRequest,
+	               EndpointIterator endpointIterator,
+	               time::Duration timeout,
+	               CallHandler handler)
+	{
 		auto asyncOperation = [this](auto && ... args)
 		{ this->asyncCallOperation(std::forward<decltype(args)>(args)...); };
-		operationManager.startOperation(asyncOperation, sendData, endpointIterator, timeout, handler);
+		operationManager.startOperation(asyncOperation, encodedRequest, endpointIterator, timeout, handler);
 	}
 
 	void cancel()
@@ -89,25 +110,31 @@ public:
 		operationManager.cancelOperation();
 	}
 
+	// Appends a CRC-32C checksum to each outgoing frame which lets the receiver detect corrupted frames.
+	void enableChecksum(bool enabled = true)
+	{
+		checksum = enabled;
+	}
+
 private:
 	// We must keep track of some variables during the async handler chain.
 	struct AsyncState
 	{
 		AsyncState(ServiceClient<Service> & client,
 			       CallHandler && handler,
-		           std::shared_ptr<std::string> && sendData,
+		           std::shared_ptr<const std::string> && sendData,
 		           time::Duration && timeout,
 		           time::TimePoint && startTime)
 			: handler(std::move(handler))
 			  , sendData(std::move(sendData))
 			  , timeout(std::move(timeout))
 			  , startTime(std::move(startTime))
-			  , buffer(client.maxMessageSize + Frame::HEADER_SIZE)
+			  , buffer(client.maxMessageSize + Frame::HEADER_SIZE + Frame::CHECKSUM_SIZE)
 			  , finishedNotifier(client.operationManager)
 		{}
 
 		CallHandler handler;
-		std::shared_ptr<std::string> sendData;
+		std::shared_ptr<const std::string> sendData;
 		time::Duration timeout;
 		time::TimePoint startTime;
 		boost::asio::streambuf buffer;
@@ -118,8 +145,10 @@ private:
 	Socket socket;
 	std::size_t maxMessageSize;
 	AsyncOperationManager<PendingOperationQueue> operationManager;
+	std::atomic<bool> checksum{false};
+	message::internal::EncodeBufferPool encodeBufferPool;
 
-	void asyncCallOperation(std::shared_ptr<std::string> & sendData,
+	void asyncCallOperation(std::shared_ptr<const std::string> & sendData,
 		                    std::string & host,
 	                        std::uint16_t & port,
 		                    time::Duration & timeout,
@@ -142,7 +171,7 @@ private:
 			{ this->connectHandler(state, error); });
 	}
 
-	void asyncCallOperation(std::shared_ptr<std::string> & sendData,
+	void asyncCallOperation(std::shared_ptr<const std::string> & sendData,
 	                        EndpointIterator & endpointIterator,
 	                        time::Duration & timeout,
 	                        CallHandler & handler)
@@ -185,7 +214,8 @@ private:
 		asionet::stream::asyncWrite(
 			socket, *sendDataRef, timeoutRef,
 			[this, state = std::move(state)](const auto & error) mutable
-			{ this->writeHandler(state, error); });
+			{ this->writeHandler(state, error); },
+			checksum);
 	}
 
 	void writeHandler(std::shared_ptr<AsyncState> & state, const error::Error & error)
@@ -225,7 +255,7 @@ private:
 
 	std::shared_ptr<std::string> encode(const RequestMessage & request, CallHandler & handler)
 	{
-		auto sendData = std::make_shared<std::string>();
+		auto sendData = encodeBufferPool.acquire();
 		if (!message::internal::encode(request, *sendData))
 		{
 			context.post(
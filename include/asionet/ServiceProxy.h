@@ -0,0 +1,396 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_SERVICEPROXY_H
+#define ASIONET_SERVICEPROXY_H
+
+#include <vector>
+#include <mutex>
+#include "Message.h"
+#include "Context.h"
+#include "AsyncOperationManager.h"
+
+namespace asionet
+{
+
+/**
+ * Accepts service requests like a ServiceServer and forwards them to one of several backend servers.
+ * The response of the backend is relayed back to the client. Requests and responses are forwarded as raw bytes,
+ * i.e. they are never decoded or re-encoded.
+ * By default, the backends are chosen round-robin. A custom BackendSelector may inspect the raw request (and even
+ * decode it on demand) to route it, e.g. by a key in its header bytes.
+ * By default, each request is forwarded over a new backend connection since a ServiceServer serves a single request
+ * per connection. If the backends keep their connections open (see ServiceServer::enableKeepAlive()), call
+ * enableBackendKeepAlive() to reuse idle backend connections instead.
+ * @tparam Service
+ */
+template<typename Service>
+class ServiceProxy
+{
+public:
+	using RequestMessage = typename Service::RequestMessage;
+	using ResponseMessage = typename Service::ResponseMessage;
+	using Protocol = boost::asio::ip::tcp;
+	using Socket = Protocol::socket;
+	using Acceptor = Protocol::acceptor;
+	using Frame = asionet::internal::Frame;
+	using Endpoint = Protocol::endpoint;
+	using RawRequestMessage = message::RawMessage<RequestMessage>;
+	// Returns the index of the backend which the request is forwarded to.
+	using BackendSelector = std::function<std::size_t(const Endpoint & clientEndpoint,
+	                                                  const RawRequestMessage & requestMessage,
+	                                                  std::size_t numBackends)>;
+
+	ServiceProxy(asionet::Context & context,
+	             std::uint16_t bindingPort,
+	             std::vector<Endpoint> backends,
+	             std::size_t maxMessageSize = 512)
+		: context(context)
+		  , bindingPort(bindingPort)
+		  , acceptor(context)
+		  , backends(std::move(backends))
+		  , idleBackendSockets(this->backends.size())
+		  , maxMessageSize(maxMessageSize)
+		  , operationManager(context, [this] { this->cancelOperation(); })
+	{}
+
+	void advertiseProxy(BackendSelector backendSelector = nullptr,
+	                    time::Duration receiveTimeout = std::chrono::seconds(60),
+	                    time::Duration backendTimeout = std::chrono::seconds(10),
+	                    time::Duration sendTimeout = std::chrono::seconds(10))
+	{
+		auto asyncOperation = [this](auto && ... args)
+		{
+			this->advertiseProxyOperation(std::forward<decltype(args)>(args)...);
+		};
+		operationManager.startOperation(asyncOperation, backendSelector, receiveTimeout, backendTimeout, sendTimeout);
+	}
+
+	void cancel()
+	{
+		operationManager.cancelOperation();
+	}
+
+	// Appends a CRC-32C checksum to each forwarded frame. Incoming checksums are always verified.
+	void enableChecksum(bool enabled = true)
+	{
+		checksum = enabled;
+	}
+
+	// Keeps up to maxIdleConnections connections per backend open after a response has been relayed and forwards
+	// later requests over them. A connection which has been closed by the backend in the meantime is replaced by a
+	// new one. Passing 0 disables the pool again.
+	void enableBackendKeepAlive(std::size_t maxIdleConnections = 4)
+	{
+		maxIdleBackendConnections = maxIdleConnections;
+		if (maxIdleConnections == 0)
+			closeIdleBackendSockets();
+	}
+
+private:
+	struct AcceptState
+	{
+		AcceptState(ServiceProxy<Service> & proxy,
+		            BackendSelector && backendSelector,
+		            time::Duration && receiveTimeout,
+		            time::Duration && backendTimeout,
+		            time::Duration && sendTimeout)
+			: backendSelector(std::move(backendSelector))
+			  , receiveTimeout(std::move(receiveTimeout))
+			  , backendTimeout(std::move(backendTimeout))
+			  , sendTimeout(std::move(sendTimeout))
+			  , finishedNotifier(proxy.operationManager)
+		{}
+
+		BackendSelector backendSelector;
+		time::Duration receiveTimeout;
+		time::Duration backendTimeout;
+		time::Duration sendTimeout;
+		AsyncOperationManager<PendingOperationReplacer>::FinishedOperationNotifier finishedNotifier;
+	};
+
+	struct ForwardState
+	{
+		ForwardState(ServiceProxy<Service> & proxy, const AcceptState & acceptState)
+			: clientSocket(proxy.context)
+			  , backendSocket(proxy.context)
+			  , clientBuffer(proxy.maxMessageSize + Frame::HEADER_SIZE + Frame::CHECKSUM_SIZE)
+			  , backendBuffer(proxy.maxMessageSize + Frame::HEADER_SIZE + Frame::CHECKSUM_SIZE)
+			  , backendSelector(acceptState.backendSelector)
+			  , receiveTimeout(acceptState.receiveTimeout)
+			  , backendTimeout(acceptState.backendTimeout)
+			  , sendTimeout(acceptState.sendTimeout)
+		{}
+
+		Socket clientSocket;
+		Socket backendSocket;
+		std::size_t backendIndex{0};
+		// Whether the backend socket has been taken from the pool of idle connections.
+		bool reusedBackendSocket{false};
+		boost::asio::streambuf clientBuffer;
+		boost::asio::streambuf backendBuffer;
+		// The encoded request and response are forwarded as they are, right from the receive buffers. Their frames are
+		// never consumed since the buffers aren't used for anything else.
+		std::size_t requestSize{0};
+		BackendSelector backendSelector;
+		time::Duration receiveTimeout;
+		time::Duration backendTimeout;
+		time::Duration sendTimeout;
+	};
+
+	asionet::Context & context;
+	std::uint16_t bindingPort;
+	Acceptor acceptor;
+	std::vector<Endpoint> backends;
+	// Idle connections per backend which are kept open for later requests.
+	std::vector<std::vector<Socket>> idleBackendSockets;
+	std::mutex idleBackendSocketsMutex;
+	std::atomic<std::size_t> maxIdleBackendConnections{0};
+	std::size_t maxMessageSize;
+	std::atomic<std::size_t> nextBackend{0};
+	std::atomic<bool> running{false};
+	AsyncOperationManager<PendingOperationReplacer> operationManager;
+	std::atomic<bool> checksum{false};
+
+	void advertiseProxyOperation(BackendSelector & backendSelector,
+	                             time::Duration & receiveTimeout,
+	                             time::Duration & backendTimeout,
+	                             time::Duration & sendTimeout)
+	{
+		running = true;
+		auto acceptState = std::make_shared<AcceptState>(
+			*this, std::move(backendSelector), std::move(receiveTimeout), std::move(backendTimeout),
+			std::move(sendTimeout));
+		accept(acceptState);
+	}
+
+	void accept(std::shared_ptr<AcceptState> & acceptState)
+	{
+		if (!acceptor.is_open())
+			acceptor = Acceptor{context, Protocol::endpoint{Protocol::v4(), bindingPort}};
+
+		auto forwardState = std::make_shared<ForwardState>(*this, *acceptState);
+
+		// keep reference due to std::move()
+		auto & socketRef = forwardState->clientSocket;
+
+		acceptor.async_accept(
+			socketRef,
+			[this, acceptState = std::move(acceptState), forwardState = std::move(forwardState)]
+				(const auto & acceptError) mutable
+			{
+				if (!running)
+					return;
+
+				if (!acceptError && !operationManager.isCanceled())
+					this->receiveRequest(forwardState);
+
+				// The next accept event will be put on the event queue.
+				this->accept(acceptState);
+			});
+	}
+
+	std::size_t selectBackend(const ForwardState & state, const RawRequestMessage & request)
+	{
+		if (state.backendSelector)
+		{
+			boost::system::error_code ignoredError;
+			auto clientEndpoint = state.clientSocket.remote_endpoint(ignoredError);
+			return state.backendSelector(clientEndpoint, request, backends.size());
+		}
+		return nextBackend++ % backends.size();
+	}
+
+	void receiveRequest(std::shared_ptr<ForwardState> & forwardState)
+	{
+		auto & socketRef = forwardState->clientSocket;
+		auto & bufferRef = forwardState->clientBuffer;
+		auto & receiveTimeoutRef = forwardState->receiveTimeout;
+
+		asionet::stream::internal::asyncReadFrame(
+			socketRef, bufferRef, receiveTimeoutRef,
+			[this, forwardState = std::move(forwardState)](const auto & errorCode, const auto & data, auto)
+			{
+				// Like the ServiceServer, we drop requests which could not be received.
+				if (errorCode || backends.empty())
+					return;
+
+				auto backendIndex = this->selectBackend(*forwardState, RawRequestMessage{data});
+				if (backendIndex >= backends.size())
+					return;
+
+				// The handler must not modify its captures, so we hand on a copy of the state.
+				auto state = forwardState;
+				state->requestSize = data.size();
+				state->backendIndex = backendIndex;
+				if (this->acquireIdleBackendSocket(*state))
+					this->writeRequest(state, time::now());
+				else
+					this->forwardRequest(state, time::now());
+			});
+	}
+
+	void forwardRequest(std::shared_ptr<ForwardState> & forwardState, time::TimePoint startTime)
+	{
+		auto & socketRef = forwardState->backendSocket;
+		auto & backend = backends[forwardState->backendIndex];
+		auto timeout = forwardState->backendTimeout - (time::now() - startTime);
+
+		asionet::socket::asyncConnect(
+			socketRef, std::vector<Endpoint>{backend}, timeout,
+			[this, forwardState = std::move(forwardState), startTime](const auto & error) mutable
+			{
+				if (error)
+					return;
+
+				this->writeRequest(forwardState, startTime);
+			});
+	}
+
+	void writeRequest(std::shared_ptr<ForwardState> & forwardState, time::TimePoint startTime)
+	{
+		auto & socketRef = forwardState->backendSocket;
+		auto request = (const char *) forwardState->clientBuffer.data().data() + Frame::HEADER_SIZE;
+		auto requestSize = forwardState->requestSize;
+		auto timeout = forwardState->backendTimeout - (time::now() - startTime);
+
+		asionet::stream::asyncWrite(
+			socketRef, request, requestSize, timeout,
+			[this, forwardState = std::move(forwardState), startTime](const auto & error) mutable
+			{
+				if (error)
+				{
+					// A timed out write closes the socket. The backend may already be processing the request then.
+					if (forwardState->backendSocket.is_open())
+						this->retryWithNewConnection(forwardState, startTime);
+					return;
+				}
+
+				this->relayResponse(forwardState, startTime);
+			},
+			checksum);
+	}
+
+	// An idle connection may have been closed by the backend in the meantime, so we try again over a new one.
+	// This is only done if the backend cannot have received the request since it must not be processed twice.
+	void retryWithNewConnection(std::shared_ptr<ForwardState> & forwardState, time::TimePoint startTime)
+	{
+		if (!forwardState->reusedBackendSocket || !running)
+			return;
+
+		forwardState->reusedBackendSocket = false;
+		boost::system::error_code ignoredError;
+		forwardState->backendSocket.close(ignoredError);
+		this->forwardRequest(forwardState, startTime);
+	}
+
+	// Whether the backend has closed the connection before it has sent any response byte. It must have done so
+	// without reading the request since a ServiceServer responds to each request it has read.
+	static bool closedBeforeResponse(const error::Error & error, std::size_t numBytesReceived)
+	{
+		auto boostCode = error.getBoostCode();
+		return numBytesReceived == 0
+		       && (boostCode == boost::asio::error::eof || boostCode == boost::asio::error::connection_reset);
+	}
+
+	void relayResponse(std::shared_ptr<ForwardState> & forwardState, time::TimePoint startTime)
+	{
+		auto & socketRef = forwardState->backendSocket;
+		auto & bufferRef = forwardState->backendBuffer;
+		auto timeout = forwardState->backendTimeout - (time::now() - startTime);
+
+		asionet::stream::internal::asyncReadFrame(
+			socketRef, bufferRef, timeout,
+			[this, forwardState = std::move(forwardState), startTime]
+				(const auto & error, const auto & response, auto numFrameBytes)
+			{
+				auto state = forwardState;
+				if (error)
+				{
+					if (closedBeforeResponse(error, numFrameBytes))
+						this->retryWithNewConnection(state, startTime);
+					return;
+				}
+
+				this->releaseBackendSocket(*state);
+
+				auto & socketRef = state->clientSocket;
+				auto & sendTimeoutRef = state->sendTimeout;
+
+				asionet::stream::asyncWrite(
+					socketRef, response.data(), response.size(), sendTimeoutRef,
+					[state](const auto &)
+					{
+						// As with the ServiceServer, there is nothing to do if the response could not be sent.
+					},
+					checksum);
+			});
+	}
+
+	bool acquireIdleBackendSocket(ForwardState & state)
+	{
+		if (maxIdleBackendConnections == 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock{idleBackendSocketsMutex};
+		auto & idleSockets = idleBackendSockets[state.backendIndex];
+		if (idleSockets.empty())
+			return false;
+
+		state.backendSocket = std::move(idleSockets.back());
+		idleSockets.pop_back();
+		state.reusedBackendSocket = true;
+		return true;
+	}
+
+	void releaseBackendSocket(ForwardState & state)
+	{
+		if (maxIdleBackendConnections == 0 || !running || !state.backendSocket.is_open())
+			return;
+
+		std::lock_guard<std::mutex> lock{idleBackendSocketsMutex};
+		auto & idleSockets = idleBackendSockets[state.backendIndex];
+		if (idleSockets.size() >= maxIdleBackendConnections)
+			return;
+
+		idleSockets.push_back(std::move(state.backendSocket));
+	}
+
+	void closeIdleBackendSockets()
+	{
+		std::lock_guard<std::mutex> lock{idleBackendSocketsMutex};
+		for (auto & idleSockets : idleBackendSockets)
+			idleSockets.clear();
+	}
+
+	void cancelOperation()
+	{
+		running = false;
+		closeable::Closer<Acceptor>::close(acceptor);
+		closeIdleBackendSockets();
+	}
+};
+
+}
+
+#endif //ASIONET_SERVICEPROXY_H
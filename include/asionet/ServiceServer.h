@@ -48,6 +48,10 @@ public:
 	using RequestReceivedHandler = std::function<void(const Endpoint & clientEndpoint,
 	                                                  RequestMessage & requestMessage,
 	                                                  ResponseMessage & response)>;
+	using RawRequestMessage = message::RawMessage<RequestMessage>;
+	using RawRequestReceivedHandler = std::function<void(const Endpoint & clientEndpoint,
+	                                                     const RawRequestMessage & requestMessage,
+	                                                     ResponseMessage & response)>;
 
 	ServiceServer(asionet::Context & context,
 	              uint16_t bindingPort,
@@ -63,11 +67,34 @@ public:
 	                      time::Duration receiveTimeout = std::chrono::seconds(60),
 	                      time::Duration sendTimeout = std::chrono::seconds(10))
 	{
-		auto asyncOperation = [this](auto && ... args)
-		{
-			this->advertiseServiceOperation(std::forward<decltype(args)>(args)...);
-		};
-		operationManager.startOperation(asyncOperation, requestReceivedHandler, receiveTimeout, sendTimeout);
+		// Requests which cannot be decoded are dropped without sending a response.
+		advertise(
+			[requestReceivedHandler = std::move(requestReceivedHandler)]
+				(const auto & clientEndpoint, const auto & rawRequest, auto & response)
+			{
+				RequestMessage request;
+				if (!rawRequest.decode(request))
+					return false;
+
+				requestReceivedHandler(clientEndpoint, request, response);
+				return true;
+			},
+			receiveTimeout, sendTimeout);
+	}
+
+	// Passes requests to the handler without decoding them. See message::RawMessage.
+	void advertiseRawService(RawRequestReceivedHandler requestReceivedHandler,
+	                         time::Duration receiveTimeout = std::chrono::seconds(60),
+	                         time::Duration sendTimeout = std::chrono::seconds(10))
+	{
+		advertise(
+			[requestReceivedHandler = std::move(requestReceivedHandler)]
+				(const auto & clientEndpoint, const auto & rawRequest, auto & response)
+			{
+				requestReceivedHandler(clientEndpoint, rawRequest, response);
+				return true;
+			},
+			receiveTimeout, sendTimeout);
 	}
 
 	void cancel()
@@ -75,11 +102,40 @@ public:
 		operationManager.cancelOperation();
 	}
 
+	// Appends a CRC-32C checksum to each outgoing frame which lets the receiver detect corrupted frames.
+	void enableChecksum(bool enabled = true)
+	{
+		checksum = enabled;
+	}
+
+	// Keeps a connection open after a response has been sent and serves further requests over it until the client
+	// closes it or the receive timeout expires. Lets a ServiceProxy reuse its backend connections.
+	void enableKeepAlive(bool enabled = true)
+	{
+		keepAlive = enabled;
+	}
+
 private:
+	// Returns whether a response should be sent.
+	using InternalRequestHandler = std::function<bool(const Endpoint & clientEndpoint,
+	                                                  const RawRequestMessage & requestMessage,
+	                                                  ResponseMessage & response)>;
+
+	void advertise(InternalRequestHandler requestReceivedHandler,
+	               time::Duration receiveTimeout,
+	               time::Duration sendTimeout)
+	{
+		auto asyncOperation = [this](auto && ... args)
+		{
+			this->advertiseServiceOperation(std::forward<decltype(args)>(args)...);
+		};
+		operationManager.startOperation(asyncOperation, requestReceivedHandler, receiveTimeout, sendTimeout);
+	}
+
 	struct AcceptState
 	{
 		AcceptState(ServiceServer<Service> & server,
-		            RequestReceivedHandler && requestReceivedHandler,
+		            InternalRequestHandler && requestReceivedHandler,
 		            time::Duration && receiveTimeout,
 		            time::Duration && sendTimeout)
 			: requestReceivedHandler(std::move(requestReceivedHandler))
@@ -88,7 +144,7 @@ private:
 			  , finishedNotifier(server.operationManager)
 		{}
 
-		RequestReceivedHandler requestReceivedHandler;
+		InternalRequestHandler requestReceivedHandler;
 		time::Duration receiveTimeout;
 		time::Duration sendTimeout;
 		AsyncOperationManager<PendingOperationReplacer>::FinishedOperationNotifier finishedNotifier;
@@ -100,7 +156,7 @@ private:
 
 		ServiceState(ServiceServer<Service> & server, const AcceptState & acceptState)
 			: socket(server.context)
-			  , buffer(server.maxMessageSize + internal::Frame::HEADER_SIZE)
+			  , buffer(server.maxMessageSize + internal::Frame::HEADER_SIZE + internal::Frame::CHECKSUM_SIZE)
 			  , requestReceivedHandler(acceptState.requestReceivedHandler)
 			  , receiveTimeout(acceptState.receiveTimeout)
 			  , sendTimeout(acceptState.sendTimeout)
@@ -108,7 +164,7 @@ private:
 
 		Socket socket;
 		boost::asio::streambuf buffer;
-		RequestReceivedHandler requestReceivedHandler;
+		InternalRequestHandler requestReceivedHandler;
 		time::Duration receiveTimeout;
 		time::Duration sendTimeout;
 	};
@@ -119,8 +175,10 @@ private:
 	std::size_t maxMessageSize;
 	std::atomic<bool> running{false};
 	AsyncOperationManager<PendingOperationReplacer> operationManager;
+	std::atomic<bool> checksum{false};
+	std::atomic<bool> keepAlive{false};
 
-	void advertiseServiceOperation(RequestReceivedHandler & requestReceivedHandler,
+	void advertiseServiceOperation(InternalRequestHandler & requestReceivedHandler,
 	                               time::Duration & receiveTimeout,
 	                               time::Duration & sendTimeout)
 	{
@@ -156,15 +214,15 @@ private:
 			});
 	}
 
-	bool handleService(std::shared_ptr<ServiceState> & serviceState)
+	void handleService(std::shared_ptr<ServiceState> & serviceState)
 	{
 		auto & socketRef = serviceState->socket;
 		auto & bufferRef = serviceState->buffer;
 		auto & receiveTimeoutRef = serviceState->receiveTimeout;
 
-		asionet::message::asyncReceive<RequestMessage>(
+		asionet::message::asyncReceiveRaw<RequestMessage>(
 			socketRef, bufferRef, receiveTimeoutRef,
-			[this, serviceState = std::move(serviceState)](const auto & errorCode, auto & request)
+			[this, serviceState = std::move(serviceState)](const auto & errorCode, const auto & request) mutable
 			{
 				// If a receive has timed out we treat it like we've never
 				// received any message (and therefor we do not call the handler).
@@ -172,18 +230,22 @@ private:
 					return;
 
 				ResponseMessage response;
-				serviceState->requestReceivedHandler(serviceState->socket.remote_endpoint(), request, response);
+				if (!serviceState->requestReceivedHandler(serviceState->socket.remote_endpoint(), request, response))
+					return;
 
 				auto & socketRef = serviceState->socket;
 				auto & sendTimeoutRef = serviceState->sendTimeout;
 
 				asionet::message::asyncSend(
 					socketRef, response, sendTimeoutRef,
-					[this, serviceState = std::move(serviceState)](const auto & errorCode)
+					[this, serviceState = std::move(serviceState)](const auto & errorCode) mutable
 					{
 						// We cannot be sure that the message is going to be received at the other side anyway,
 						// so we don't handle anything sending-wise.
-					});
+						if (!errorCode && keepAlive && running)
+							this->handleService(serviceState);
+					},
+					checksum);
 			});
 	}
 
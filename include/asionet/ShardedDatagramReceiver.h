@@ -0,0 +1,114 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_SHARDEDDATAGRAMRECEIVER_H
+#define ASIONET_SHARDEDDATAGRAMRECEIVER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "DatagramReceiver.h"
+
+namespace asionet
+{
+
+/**
+ * Receives datagrams of a single port with several sockets bound via SO_REUSEPORT (Linux, BSD).
+ * The kernel distributes incoming datagrams between the sockets (shards) by a hash of the sender's address, so all
+ * datagrams of a sender arrive at the same shard in order while different senders are received in parallel.
+ * Each shard is a DatagramReceiver with its own receive loop. Shards may share a context which is run by several
+ * threads or each shard may get its own context, e.g. to pin it to a thread.
+ * The handler passed to startReceiving() is called concurrently by different shards.
+ */
+template<typename Message>
+class ShardedDatagramReceiver
+{
+public:
+	using Shard = DatagramReceiver<Message>;
+	using ReceiveHandler = typename Shard::ReceiveHandler;
+
+	// Creates one shard per context.
+	ShardedDatagramReceiver(const std::vector<std::reference_wrapper<asionet::Context>> & contexts,
+	                        std::uint16_t bindingPort,
+	                        std::size_t maxMessageSize = 512,
+	                        std::size_t maxBatchSize = 64)
+	{
+		for (auto & context : contexts)
+			addShard(context, bindingPort, maxMessageSize, maxBatchSize);
+	}
+
+	ShardedDatagramReceiver(asionet::Context & context,
+	                        std::size_t numShards,
+	                        std::uint16_t bindingPort,
+	                        std::size_t maxMessageSize = 512,
+	                        std::size_t maxBatchSize = 64)
+	{
+		for (std::size_t i = 0; i < numShards; ++i)
+			addShard(context, bindingPort, maxMessageSize, maxBatchSize);
+	}
+
+	// Starts the continuous receive loop of each shard (see DatagramReceiver::startReceiving()).
+	void startReceiving(ReceiveHandler handler)
+	{
+		startReceiving(time::Duration::zero(), std::move(handler));
+	}
+
+	void startReceiving(time::Duration idleTimeout, ReceiveHandler handler)
+	{
+		for (auto & shard : shards)
+			shard->startReceiving(idleTimeout, handler);
+	}
+
+	void cancel()
+	{
+		for (auto & shard : shards)
+			shard->cancel();
+	}
+
+	std::size_t getNumShards() const
+	{
+		return shards.size();
+	}
+
+	// Gives access to a single shard, e.g. to receive batches or to join multicast groups.
+	Shard & getShard(std::size_t index)
+	{
+		return *shards[index];
+	}
+
+private:
+	std::vector<std::unique_ptr<Shard>> shards;
+
+	void addShard(asionet::Context & context,
+	              std::uint16_t bindingPort,
+	              std::size_t maxMessageSize,
+	              std::size_t maxBatchSize)
+	{
+		shards.push_back(std::make_unique<Shard>(context, bindingPort, maxMessageSize, maxBatchSize));
+		shards.back()->enableReusePort();
+	}
+};
+
+}
+
+#endif //ASIONET_SHARDEDDATAGRAMRECEIVER_H
@@ -0,0 +1,114 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_SHAREDBYTES_H
+#define ASIONET_SHAREDBYTES_H
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+namespace asionet
+{
+
+/**
+ * Immutable, reference-counted view of a range of bytes inside a byte block.
+ * Receiving a SharedBytes message moves ownership of the receive buffer into the message (if the receive path
+ * supports it), so the payload reaches the application without being copied. The receiver continues with a fresh
+ * buffer while the block stays alive as long as any SharedBytes object refers to it.
+ */
+class SharedBytes
+{
+public:
+	using Block = std::vector<char>;
+	using ConstIterator = const char *;
+
+	SharedBytes() = default;
+
+	SharedBytes(std::shared_ptr<const Block> block, std::size_t offset, std::size_t numBytes)
+		: block(std::move(block)), offset(offset), numBytes(numBytes)
+	{}
+
+	// Copies the given bytes into a new block.
+	static SharedBytes copy(const char * bytes, std::size_t numBytes)
+	{
+		return SharedBytes{std::make_shared<const Block>(bytes, bytes + numBytes), 0, numBytes};
+	}
+
+	char operator[](std::size_t pos) const
+	{
+		return data()[pos];
+	}
+
+	const char * data() const
+	{
+		return block ? block->data() + offset : nullptr;
+	}
+
+	std::size_t size() const
+	{
+		return numBytes;
+	}
+
+	bool empty() const
+	{
+		return numBytes == 0;
+	}
+
+	ConstIterator begin() const
+	{
+		return data();
+	}
+
+	ConstIterator end() const
+	{
+		return data() + numBytes;
+	}
+
+	// Lets SharedBytes be passed to decoders as a ConstBuffer.
+	SharedBytes share() const
+	{
+		return *this;
+	}
+
+	// Returns a view of numBytes bytes starting at pos which shares the same block.
+	SharedBytes slice(std::size_t pos, std::size_t numBytes) const
+	{
+		assert(pos + numBytes <= this->numBytes);
+		return SharedBytes{block, offset + pos, numBytes};
+	}
+
+	const std::shared_ptr<const Block> & getBlock() const
+	{
+		return block;
+	}
+
+private:
+	std::shared_ptr<const Block> block{nullptr};
+	std::size_t offset{0};
+	std::size_t numBytes{0};
+};
+
+}
+
+#endif //ASIONET_SHAREDBYTES_H
@@ -37,18 +37,31 @@ namespace socket
 namespace internal
 {
 
-inline bool numDataBytesFromBuffer(const std::vector<char> & buffer, std::size_t numBytesTransferred, std::size_t & numDataBytes)
+inline bool numDataBytesFromBuffer(const char * buffer, std::size_t numBytesTransferred, std::size_t & numDataBytes)
 {
-    if (numBytesTransferred < 4)
+    using asionet::internal::Frame;
+
+    if (numBytesTransferred < Frame::HEADER_SIZE)
+        return false;
+
+    auto bytes = (const std::uint8_t *) buffer;
+    bool hasChecksum{false};
+    numDataBytes = Frame::parseHeader(bytes, hasChecksum);
+    if (numBytesTransferred < Frame::HEADER_SIZE + numDataBytes + (hasChecksum ? Frame::CHECKSUM_SIZE : 0))
         return false;
 
-    numDataBytes = utils::fromBigEndian<4, std::uint32_t>((const std::uint8_t *) buffer.data());
-    if (numBytesTransferred < 4 + numDataBytes)
+    if (hasChecksum && !Frame::verifyChecksum(
+        bytes + Frame::HEADER_SIZE, numDataBytes, bytes + Frame::HEADER_SIZE + numDataBytes))
         return false;
 
     return true;
 }
 
+inline bool numDataBytesFromBuffer(const std::vector<char> & buffer, std::size_t numBytesTransferred, std::size_t & numDataBytes)
+{
+    return numDataBytesFromBuffer(buffer.data(), numBytesTransferred, numDataBytes);
+}
+
 }
 
 using ConnectHandler = std::function<void(const error::Error & error)>;
@@ -132,10 +145,11 @@ void asyncSendTo(DatagramSocket & socket,
                  const std::string & ip,
                  std::uint16_t port,
                  const time::Duration & timeout,
-                 SendHandler handler)
+                 SendHandler handler,
+                 bool checksum = false)
 {
     using Endpoint = boost::asio::ip::udp::endpoint;
-    asyncSendTo(socket, sendData, Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler);
+    asyncSendTo(socket, sendData, Endpoint{boost::asio::ip::address::from_string(ip), port}, timeout, handler, checksum);
 };
 
 template<typename DatagramSocket, typename Endpoint>
@@ -143,10 +157,18 @@ void asyncSendTo(DatagramSocket & socket,
                  const std::string & sendData,
                  const Endpoint & endpoint,
                  const time::Duration & timeout,
-                 SendHandler handler)
+                 SendHandler handler,
+                 bool checksum = false)
 {
     using namespace asionet::internal;
-    auto frame = std::make_shared<Frame>((const std::uint8_t *) sendData.c_str(), sendData.size());
+    if (sendData.size() > Frame::MAX_DATA_SIZE)
+    {
+        // The size would overflow into the header's flags.
+        socket.get_executor().context().post([handler] { handler(error::encoding); });
+        return;
+    }
+
+    auto frame = std::make_shared<Frame>((const std::uint8_t *) sendData.c_str(), sendData.size(), checksum);
     auto && buffers = frame->getBuffers();
 
     auto asyncOperation = [&socket](auto && ... args)
@@ -167,9 +189,13 @@ void asyncSendTo(DatagramSocket & socket,
         buffers, endpoint);
 };
 
+namespace internal
+{
+
 template<typename DatagramSocket>
 void asyncReceiveFrom(DatagramSocket & socket,
                       std::vector<char> & buffer,
+                      std::shared_ptr<const std::vector<char>> owner,
                       const time::Duration & timeout,
                       ReceiveHandler handler)
 {
@@ -186,7 +212,8 @@ void asyncReceiveFrom(DatagramSocket & socket,
 
     closeable::timedAsyncOperation(
         asyncOperation, socket, timeout,
-        [&buffer, handler = std::move(handler), senderEndpoint = std::move(senderEndpoint)](const auto & error, auto numBytesTransferred)
+        [&buffer, owner = std::move(owner), handler = std::move(handler), senderEndpoint = std::move(senderEndpoint)]
+            (const auto & error, auto numBytesTransferred)
         {
             if (error)
             {
@@ -201,12 +228,36 @@ void asyncReceiveFrom(DatagramSocket & socket,
                 return;
             }
 
-            handler(error, ConstVectorBuffer{buffer, numDataBytes, Frame::HEADER_SIZE}, *senderEndpoint);
+            handler(error, ConstVectorBuffer{buffer, numDataBytes, Frame::HEADER_SIZE, owner}, *senderEndpoint);
         },
         boost::asio::buffer(buffer),
         senderEndpointRef);
 }
 
+}
+
+template<typename DatagramSocket>
+void asyncReceiveFrom(DatagramSocket & socket,
+                      std::vector<char> & buffer,
+                      const time::Duration & timeout,
+                      ReceiveHandler handler)
+{
+    internal::asyncReceiveFrom(socket, buffer, nullptr, timeout, std::move(handler));
+}
+
+// The buffer is kept alive until the handler returns. Since the handler's ConstVectorBuffer shares its ownership,
+// a decoder may keep (parts of) the buffer without copying it.
+template<typename DatagramSocket>
+void asyncReceiveFrom(DatagramSocket & socket,
+                      std::shared_ptr<std::vector<char>> buffer,
+                      const time::Duration & timeout,
+                      ReceiveHandler handler)
+{
+    // keep reference because of std::move()
+    auto & bufferRef = *buffer;
+    internal::asyncReceiveFrom(socket, bufferRef, std::move(buffer), timeout, std::move(handler));
+}
+
 }
 }
 
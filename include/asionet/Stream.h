@@ -24,6 +24,7 @@
 #ifndef ASIONET_STREAM_H
 #define ASIONET_STREAM_H
 
+#include <atomic>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio.hpp>
 #include "Timer.h"
@@ -41,11 +42,16 @@ namespace stream
 namespace internal
 {
 
-inline std::uint32_t numDataBytesFromBuffer(boost::asio::streambuf & streambuf)
+inline std::uint32_t numDataBytesFromBuffer(boost::asio::streambuf & streambuf, bool & hasChecksum)
 {
-    auto numDataBytesStr = std::string{boost::asio::buffers_begin(streambuf.data()),
-                                       boost::asio::buffers_begin(streambuf.data()) + asionet::internal::Frame::HEADER_SIZE};
-    return utils::fromBigEndian<4, std::uint32_t>((const std::uint8_t *) numDataBytesStr.c_str());
+    return asionet::internal::Frame::parseHeader((const std::uint8_t *) streambuf.data().data(), hasChecksum);
+}
+
+inline bool verifyChecksum(boost::asio::streambuf & streambuf, std::size_t numDataBytes)
+{
+    using asionet::internal::Frame;
+    auto bytes = (const std::uint8_t *) streambuf.data().data();
+    return Frame::verifyChecksum(bytes + Frame::HEADER_SIZE, numDataBytes, bytes + Frame::HEADER_SIZE + numDataBytes);
 }
 
 }
@@ -54,14 +60,46 @@ using WriteHandler = std::function<void(const error::Error & error)>;
 
 using ReadHandler = std::function<void(const error::Error & error, const asionet::internal::ConstStreamBuffer & data)>;
 
+// Fills 'chunk' with the next chunk to be written. Returns false if there are no more chunks.
+using ChunkSource = std::function<bool(std::string & chunk)>;
+
+// Called for each received chunk. Returning false aborts the transfer.
+using ChunkHandler = std::function<bool(const asionet::internal::ConstStreamBuffer & chunk,
+                                        std::uint64_t numBytesReceived)>;
+
+// Starts reading the next chunk of a paused transfer. See PausableChunkHandler.
+using ResumeHandler = std::function<void()>;
+
+// Like ChunkHandler, but the next chunk is not read before 'resume' has been called (see asyncReadChunkedPausable()).
+// This may happen after the handler has returned, e.g. once the chunk has been processed elsewhere, which throttles
+// the sender.
+// 'resume' must be called exactly once unless the handler returns false.
+using PausableChunkHandler = std::function<bool(const asionet::internal::ConstStreamBuffer & chunk,
+                                                std::uint64_t numBytesReceived,
+                                                const ResumeHandler & resume)>;
+
+using ChunkedWriteHandler = std::function<void(const error::Error & error, std::uint64_t numBytesWritten)>;
+
+using ChunkedReadHandler = std::function<void(const error::Error & error, std::uint64_t numBytesReceived)>;
+
+// Writes 'size' bytes starting at 'data' as one frame. The bytes must stay valid until the handler has been called.
 template<typename SyncWriteStream>
 void asyncWrite(SyncWriteStream & stream,
-                const std::string & writeData,
+                const char * data,
+                std::size_t size,
                 const time::Duration & timeout,
-                WriteHandler handler)
+                WriteHandler handler,
+                bool checksum = false)
 {
     using namespace asionet::internal;
-    auto frame = std::make_shared<Frame>((const std::uint8_t *) writeData.c_str(), writeData.size());
+    if (size > Frame::MAX_DATA_SIZE)
+    {
+        // The size would overflow into the header's flags.
+        stream.get_executor().context().post([handler] { handler(error::encoding); });
+        return;
+    }
+
+    auto frame = std::make_shared<Frame>((const std::uint8_t *) data, size, checksum);
     auto buffers = frame->getBuffers();
 
     auto asyncOperation = [](auto && ... args) { boost::asio::async_write(std::forward<decltype(args)>(args)...); };
@@ -81,11 +119,29 @@ void asyncWrite(SyncWriteStream & stream,
         stream, buffers);
 }
 
-template<typename SyncReadStream>
-void asyncRead(SyncReadStream & stream,
-               boost::asio::streambuf & buffer,
-               const time::Duration & timeout,
-               ReadHandler handler)
+template<typename SyncWriteStream>
+void asyncWrite(SyncWriteStream & stream,
+                const std::string & writeData,
+                const time::Duration & timeout,
+                WriteHandler handler,
+                bool checksum = false)
+{
+    asyncWrite(stream, writeData.data(), writeData.size(), timeout, std::move(handler), checksum);
+}
+
+namespace internal
+{
+
+/**
+ * Like asyncRead(), but leaves consuming the frame from the buffer to the handler. It is called with the error, the
+ * data and the number of bytes to consume. This way, a handler may keep the bytes in the buffer after it has returned
+ * or consume them before it starts the next read.
+ */
+template<typename SyncReadStream, typename Handler>
+void asyncReadFrame(SyncReadStream & stream,
+                    boost::asio::streambuf & buffer,
+                    const time::Duration & timeout,
+                    Handler handler)
 {
     using asionet::internal::Frame;
     using asionet::internal::ConstStreamBuffer;
@@ -103,23 +159,21 @@ void asyncRead(SyncReadStream & stream,
         {
             if (error)
             {
-                handler(error, ConstStreamBuffer{buffer, 0, 0});
-                buffer.consume(numBytesTransferred);
+                handler(error, ConstStreamBuffer{buffer, 0, 0}, numBytesTransferred);
                 return;
             }
 
             if (numBytesTransferred != Frame::HEADER_SIZE)
             {
-                handler(error::invalidFrame, ConstStreamBuffer{buffer, 0, 0});
-                buffer.consume(numBytesTransferred);
+                handler(error::invalidFrame, ConstStreamBuffer{buffer, 0, 0}, numBytesTransferred);
                 return;
             }
 
-            auto numDataBytes = numDataBytesFromBuffer(buffer);
-            if (numDataBytes == 0)
+            bool hasChecksum{false};
+            auto numDataBytes = numDataBytesFromBuffer(buffer, hasChecksum);
+            if (numDataBytes == 0 && !hasChecksum)
             {
-                handler(error, ConstStreamBuffer{buffer, 0, 0});
-                buffer.consume(numBytesTransferred);
+                handler(error, ConstStreamBuffer{buffer, 0, 0}, numBytesTransferred);
                 return;
             }
 
@@ -129,34 +183,248 @@ void asyncRead(SyncReadStream & stream,
 	        auto asyncOperation = [](auto && ... args) { boost::asio::async_read(std::forward<decltype(args)>(args)...); };
 
             // Receive actual data.
-            // At this point, we DON'T consume the frame's header bytes in the buffer which we're going to do in the following handler.
+            // The frame's header bytes stay in the buffer, they're consumed along with the data.
             closeable::timedAsyncOperation(
                 asyncOperation, stream, newTimeout,
-                [&buffer, handler = std::move(handler), numDataBytes]
+                [&buffer, handler = std::move(handler), numDataBytes, hasChecksum]
                     (const auto & error, auto numBytesTransferred)
                 {
+                    auto numBytesRead = Frame::HEADER_SIZE + numBytesTransferred;
                     if (error)
                     {
-                        handler(error, ConstStreamBuffer{buffer, 0, 0});
-                        buffer.consume(Frame::HEADER_SIZE + numBytesTransferred);
+                        handler(error, ConstStreamBuffer{buffer, 0, 0}, numBytesRead);
                         return;
                     }
 
-                    if (numBytesTransferred != numDataBytes)
+                    auto numFrameBytes = numDataBytes + (hasChecksum ? Frame::CHECKSUM_SIZE : 0);
+                    if (numBytesTransferred != numFrameBytes)
                     {
-                        handler(error::invalidFrame, ConstStreamBuffer{buffer, 0, 0});
-                        buffer.consume(Frame::HEADER_SIZE + numBytesTransferred);
+                        handler(error::invalidFrame, ConstStreamBuffer{buffer, 0, 0}, numBytesRead);
                         return;
                     }
 
-                    handler(error, ConstStreamBuffer{buffer, numDataBytes, Frame::HEADER_SIZE});
-                    buffer.consume(Frame::HEADER_SIZE + numBytesTransferred);
+                    // Verify the checksum before anyone gets to see the data.
+                    if (hasChecksum && !verifyChecksum(buffer, numDataBytes))
+                    {
+                        handler(error::invalidFrame, ConstStreamBuffer{buffer, 0, 0}, numBytesRead);
+                        return;
+                    }
+
+                    handler(error, ConstStreamBuffer{buffer, numDataBytes, Frame::HEADER_SIZE}, numBytesRead);
                 },
-                stream, buffer, boost::asio::transfer_exactly(numDataBytes));
+                stream, buffer, boost::asio::transfer_exactly(numDataBytes + (hasChecksum ? Frame::CHECKSUM_SIZE : 0)));
         },
         stream, buffer, boost::asio::transfer_exactly(Frame::HEADER_SIZE));
+}
+
+}
+
+template<typename SyncReadStream>
+void asyncRead(SyncReadStream & stream,
+               boost::asio::streambuf & buffer,
+               const time::Duration & timeout,
+               ReadHandler handler)
+{
+    internal::asyncReadFrame(
+        stream, buffer, timeout,
+        [&buffer, handler = std::move(handler)](const auto & error, const auto & data, auto numFrameBytes)
+        {
+            handler(error, data);
+            buffer.consume(numFrameBytes);
+        });
+}
+
+namespace internal
+{
+
+struct ChunkedWriteState
+{
+    ChunkedWriteState(ChunkSource && source, ChunkedWriteHandler && handler, bool checksum)
+        : source(std::move(source)), handler(std::move(handler)), checksum(checksum)
+    {}
+
+    ChunkSource source;
+    ChunkedWriteHandler handler;
+    bool checksum;
+    std::string chunk;
+    std::uint64_t numBytesWritten{0};
+    bool finished{false};
 };
 
+struct ChunkedReadState
+{
+    ChunkedReadState(PausableChunkHandler && chunkHandler, ChunkedReadHandler && handler)
+        : chunkHandler(std::move(chunkHandler)), handler(std::move(handler))
+    {}
+
+    PausableChunkHandler chunkHandler;
+    ChunkedReadHandler handler;
+    std::uint64_t numBytesReceived{0};
+    // The next chunk is read as soon as both the chunk handler has returned and the transfer has been resumed.
+    std::atomic<int> numPendingResumes{0};
+};
+
+template<typename SyncWriteStream>
+void writeNextChunk(SyncWriteStream & stream, const time::Duration & timeout, std::shared_ptr<ChunkedWriteState> state)
+{
+    state->chunk.clear();
+    try
+    {
+        // Empty chunks are skipped since an empty frame terminates the transfer.
+        while (!state->finished && state->chunk.empty())
+            state->finished = !state->source(state->chunk);
+    }
+    catch (...)
+    {
+        stream.get_executor().context().post(
+            [state] { state->handler(error::encoding, state->numBytesWritten); });
+        return;
+    }
+
+    if (state->finished)
+        state->chunk.clear();
+
+    // keep reference and flag because of std::move()
+    auto & chunkRef = state->chunk;
+    auto checksum = state->checksum;
+
+    asyncWrite(
+        stream, chunkRef, timeout,
+        [&stream, timeout, state = std::move(state)](const auto & error) mutable
+        {
+            if (error)
+            {
+                state->handler(error, state->numBytesWritten);
+                return;
+            }
+
+            state->numBytesWritten += state->chunk.size();
+            if (state->finished)
+            {
+                state->handler(error, state->numBytesWritten);
+                return;
+            }
+
+            writeNextChunk(stream, timeout, std::move(state));
+        },
+        checksum);
+}
+
+template<typename SyncReadStream>
+void resumeChunkedRead(SyncReadStream & stream,
+                       boost::asio::streambuf & buffer,
+                       const time::Duration & timeout,
+                       std::shared_ptr<ChunkedReadState> state);
+
+template<typename SyncReadStream>
+void readNextChunk(SyncReadStream & stream,
+                   boost::asio::streambuf & buffer,
+                   const time::Duration & timeout,
+                   std::shared_ptr<ChunkedReadState> state)
+{
+    asyncReadFrame(
+        stream, buffer, timeout,
+        [&stream, &buffer, timeout, state = std::move(state)]
+            (const auto & error, const auto & chunk, auto numFrameBytes)
+        {
+            if (error || chunk.size() == 0)
+            {
+                // An empty frame terminates the transfer.
+                buffer.consume(numFrameBytes);
+                state->handler(error, state->numBytesReceived);
+                return;
+            }
+
+            state->numBytesReceived += chunk.size();
+            state->numPendingResumes = 2;
+            ResumeHandler resume = [&stream, &buffer, timeout, state]
+            { resumeChunkedRead(stream, buffer, timeout, state); };
+
+            auto resumed = state->chunkHandler(chunk, state->numBytesReceived, resume);
+            // The next read must not start before the chunk has been consumed, even if the transfer has been resumed
+            // by another thread in the meantime. Hence, the chunk handler only counts as returned afterwards.
+            buffer.consume(numFrameBytes);
+            if (!resumed)
+            {
+                state->handler(error::aborted, state->numBytesReceived);
+                return;
+            }
+
+            resumeChunkedRead(stream, buffer, timeout, state);
+        });
+}
+
+template<typename SyncReadStream>
+void resumeChunkedRead(SyncReadStream & stream,
+                       boost::asio::streambuf & buffer,
+                       const time::Duration & timeout,
+                       std::shared_ptr<ChunkedReadState> state)
+{
+    if (--state->numPendingResumes != 0)
+        return;
+
+    stream.get_executor().context().post(
+        [&stream, &buffer, timeout, state = std::move(state)]() mutable
+        { readNextChunk(stream, buffer, timeout, std::move(state)); });
+}
+
+}
+
+/**
+ * Writes a message of arbitrary size as a sequence of frames (chunks) which is terminated by an empty frame.
+ * The source is asked for the next chunk only after the previous one has been written, so the sender never holds more
+ * than a single chunk in memory. The timeout applies to each chunk separately.
+ */
+template<typename SyncWriteStream>
+void asyncWriteChunked(SyncWriteStream & stream,
+                       ChunkSource source,
+                       const time::Duration & timeout,
+                       ChunkedWriteHandler handler,
+                       bool checksum = false)
+{
+    auto state = std::make_shared<internal::ChunkedWriteState>(std::move(source), std::move(handler), checksum);
+    internal::writeNextChunk(stream, timeout, std::move(state));
+}
+
+// Like asyncReadChunked(), but the next chunk is not read before chunkHandler has resumed the transfer.
+template<typename SyncReadStream>
+void asyncReadChunkedPausable(SyncReadStream & stream,
+                              boost::asio::streambuf & buffer,
+                              const time::Duration & timeout,
+                              PausableChunkHandler chunkHandler,
+                              ChunkedReadHandler handler)
+{
+    auto state = std::make_shared<internal::ChunkedReadState>(std::move(chunkHandler), std::move(handler));
+    internal::readNextChunk(stream, buffer, timeout, std::move(state));
+}
+
+/**
+ * Reads a message which was written by asyncWriteChunked() chunk by chunk.
+ * Each chunk is passed to chunkHandler as soon as it has arrived and is consumed from the buffer afterwards.
+ * The next chunk is not read before chunkHandler returns. Therefore, the buffer only has to be large enough
+ * for a single chunk. The timeout applies to each chunk separately.
+ * If the transfer is aborted or fails, the stream is left in the middle of the transfer and should be closed.
+ */
+template<typename SyncReadStream>
+void asyncReadChunked(SyncReadStream & stream,
+                      boost::asio::streambuf & buffer,
+                      const time::Duration & timeout,
+                      ChunkHandler chunkHandler,
+                      ChunkedReadHandler handler)
+{
+    asyncReadChunkedPausable(
+        stream, buffer, timeout,
+        [chunkHandler = std::move(chunkHandler)](const auto & chunk, auto numBytesReceived, const auto & resume)
+        {
+            if (!chunkHandler(chunk, numBytesReceived))
+                return false;
+
+            resume();
+            return true;
+        },
+        std::move(handler));
+}
+
 }
 }
 
@@ -0,0 +1,200 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_TRIVIALCODEC_H
+#define ASIONET_TRIVIALCODEC_H
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include "Message.h"
+#include "BinaryCodec.h"
+#include "ByteOrder.h"
+
+namespace asionet
+{
+namespace codec
+{
+namespace internal
+{
+
+// Trivially copyable types are encoded by copying their memory. Pointers are excluded because they are meaningless
+// to the receiver and so are structs which declare their fields for the binary codec.
+template<typename T>
+struct IsTrivialMessage : std::integral_constant<bool, std::is_trivially_copyable<T>::value
+                                                       && !std::is_pointer<T>::value
+                                                       && !std::is_member_pointer<T>::value
+                                                       && !HasFields<T>::value> {};
+
+// std::vector<bool> packs its elements into bits and has no data(), so it can't be copied as a whole.
+template<typename T>
+struct IsTrivialElement : std::integral_constant<bool, IsTrivialMessage<T>::value
+                                                       && !std::is_same<std::remove_cv_t<T>, bool>::value> {};
+
+// Number of bytes of the scalars which make up a trivial message or 1 if its byte order is left unchanged.
+template<typename T, typename = void>
+struct ScalarSize : std::integral_constant<std::size_t, 1> {};
+
+template<typename T>
+struct ScalarSize<T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>>
+	: std::integral_constant<std::size_t, sizeof(T)> {};
+
+template<typename T, std::size_t N>
+struct ScalarSize<std::array<T, N>> : ScalarSize<T> {};
+
+// Converts between host and big-endian byte order in place. Converting twice yields the original bytes.
+template<std::size_t scalarSize>
+inline void convertByteOrder(char * data, std::size_t numBytes)
+{
+	if (scalarSize > 1 && utils::isLittleEndian())
+		utils::swapByteOrder<scalarSize>(data, numBytes / scalarSize);
+}
+
+inline void throwSizeMismatch()
+{ throw std::runtime_error{"asionet::codec: message size does not match its type."}; }
+
+}
+}
+
+namespace message
+{
+
+/**
+ * Encodes trivially copyable messages (and std::vectors of them) by copying their memory.
+ * Integers, enums and floating point numbers (and std::arrays of them) are converted to big-endian byte order.
+ * Other types like structs are sent in their native memory layout, so sender and receiver have to agree on it,
+ * i.e. use the same compiler, architecture and packing.
+ */
+template<typename Message>
+struct Encoder<Message, std::enable_if_t<codec::internal::IsTrivialMessage<Message>::value>>
+{
+	void operator()(const Message & message, std::string & data) const
+	{
+		data.clear();
+		append(message, data);
+	}
+
+	void append(const Message & message, std::string & data) const
+	{
+		auto offset = data.size();
+		data.resize(offset + sizeof(Message));
+		std::memcpy(&data[offset], &message, sizeof(Message));
+		codec::internal::convertByteOrder<codec::internal::ScalarSize<Message>::value>(&data[offset], sizeof(Message));
+	}
+};
+
+// Throws if the size of the buffer differs from the size of the message.
+template<typename Message>
+struct Decoder<Message, std::enable_if_t<codec::internal::IsTrivialMessage<Message>::value>>
+{
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & buffer, Message & message) const
+	{
+		if (buffer.size() != sizeof(Message))
+			codec::internal::throwSizeMismatch();
+
+		std::memcpy(&message, buffer.data(), sizeof(Message));
+		codec::internal::convertByteOrder<codec::internal::ScalarSize<Message>::value>(
+			(char *) &message, sizeof(Message));
+	}
+};
+
+template<typename T>
+struct Encoder<std::vector<T>, std::enable_if_t<codec::internal::IsTrivialElement<T>::value>>
+{
+	void operator()(const std::vector<T> & message, std::string & data) const
+	{
+		data.clear();
+		append(message, data);
+	}
+
+	void append(const std::vector<T> & message, std::string & data) const
+	{
+		auto offset = data.size();
+		auto numBytes = message.size() * sizeof(T);
+		if (numBytes == 0)
+			return;
+
+		data.resize(offset + numBytes);
+		std::memcpy(&data[offset], message.data(), numBytes);
+		codec::internal::convertByteOrder<codec::internal::ScalarSize<T>::value>(&data[offset], numBytes);
+	}
+};
+
+// Throws if the size of the buffer is not a multiple of the element size.
+template<typename T>
+struct Decoder<std::vector<T>, std::enable_if_t<codec::internal::IsTrivialElement<T>::value>>
+{
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & buffer, std::vector<T> & message) const
+	{
+		if (buffer.size() % sizeof(T) != 0)
+			codec::internal::throwSizeMismatch();
+
+		message.resize(buffer.size() / sizeof(T));
+		if (message.empty())
+			return;
+
+		std::memcpy(message.data(), buffer.data(), buffer.size());
+		codec::internal::convertByteOrder<codec::internal::ScalarSize<T>::value>(
+			(char *) message.data(), buffer.size());
+	}
+};
+
+// Encodes each element as a single byte like a std::vector of any other trivial type of that size.
+template<>
+struct Encoder<std::vector<bool>>
+{
+	void operator()(const std::vector<bool> & message, std::string & data) const
+	{
+		data.clear();
+		append(message, data);
+	}
+
+	void append(const std::vector<bool> & message, std::string & data) const
+	{
+		data.reserve(data.size() + message.size());
+		for (bool element : message)
+			data.push_back(element ? 1 : 0);
+	}
+};
+
+template<>
+struct Decoder<std::vector<bool>>
+{
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & buffer, std::vector<bool> & message) const
+	{
+		message.resize(buffer.size());
+		for (std::size_t i = 0; i < buffer.size(); ++i)
+			message[i] = buffer[i] != 0;
+	}
+};
+
+}
+}
+
+#endif //ASIONET_TRIVIALCODEC_H
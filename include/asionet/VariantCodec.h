@@ -0,0 +1,142 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_VARIANTCODEC_H
+#define ASIONET_VARIANTCODEC_H
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <boost/variant.hpp>
+#include "Message.h"
+#include "ConstBuffer.h"
+
+namespace asionet
+{
+namespace utils
+{
+
+template<typename... Functions>
+struct Overload;
+
+template<typename Function>
+struct Overload<Function> : Function
+{
+	explicit Overload(Function function)
+		: Function(std::move(function))
+	{}
+
+	using Function::operator();
+};
+
+template<typename Function, typename... Functions>
+struct Overload<Function, Functions...> : Function, Overload<Functions...>
+{
+	explicit Overload(Function function, Functions... functions)
+		: Function(std::move(function)), Overload<Functions...>(std::move(functions)...)
+	{}
+
+	using Function::operator();
+	using Overload<Functions...>::operator();
+};
+
+// Combines several function objects into one overloaded function object.
+// This way, a handler per alternative can be passed to boost::apply_visitor() in order to dispatch a variant message.
+template<typename... Functions>
+Overload<std::decay_t<Functions>...> overload(Functions &&... functions)
+{
+	return Overload<std::decay_t<Functions>...>{std::forward<Functions>(functions)...};
+}
+
+}
+
+namespace message
+{
+namespace internal
+{
+
+template<typename Alternative, typename Variant, typename ConstBuffer>
+void decodeAlternative(const ConstBuffer & payload, Variant & message)
+{
+	Alternative alternative{};
+	Decoder<Alternative>{}(payload, alternative);
+	message = std::move(alternative);
+}
+
+}
+
+/**
+ * Encodes a boost::variant as a single byte holding the index of the active alternative followed by the encoded
+ * alternative. This way, a single DatagramReceiver, ServiceServer etc. can handle several message types.
+ * The alternatives have to be in the same order on both sides.
+ */
+template<typename... Alternatives>
+struct Encoder<boost::variant<Alternatives...>>
+{
+	static_assert(sizeof...(Alternatives) <= 256, "A variant message may have at most 256 alternatives.");
+
+	void operator()(const boost::variant<Alternatives...> & message, std::string & data) const
+	{
+		data.clear();
+		append(message, data);
+	}
+
+	// The index is written first, so the alternative is encoded behind it without moving its bytes afterwards.
+	void append(const boost::variant<Alternatives...> & message, std::string & data) const
+	{
+		data.push_back((char) message.which());
+		boost::apply_visitor([&data](const auto & alternative)
+		                     { internal::encodeAppending(alternative, data); },
+		                     message);
+	}
+};
+
+// The decoder of the alternative is looked up by the type index in a table which is built at compile time.
+template<typename... Alternatives>
+struct Decoder<boost::variant<Alternatives...>>
+{
+	using Variant = boost::variant<Alternatives...>;
+
+	template<typename ConstBuffer>
+	void operator()(const ConstBuffer & buffer, Variant & message) const
+	{
+		using Payload = asionet::internal::ConstBufferView<ConstBuffer>;
+		using DecodeFunction = void (*)(const Payload &, Variant &);
+		static constexpr DecodeFunction decodeFunctions[] = {&internal::decodeAlternative<Alternatives, Variant, Payload>...};
+
+		if (buffer.size() < 1)
+			throw std::runtime_error{"asionet: variant message lacks its type index."};
+
+		auto index = (std::uint8_t) buffer[0];
+		if (index >= sizeof...(Alternatives))
+			throw std::runtime_error{"asionet: unknown type index of variant message."};
+
+		decodeFunctions[index](Payload{buffer, buffer.size() - 1, 1}, message);
+	}
+};
+
+}
+}
+
+#endif //ASIONET_VARIANTCODEC_H
@@ -0,0 +1,273 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_VARINT_H
+#define ASIONET_VARINT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include "ByteOrder.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <tmmintrin.h>
+#define ASIONET_VARINT_SIMD
+#endif
+
+namespace asionet
+{
+namespace utils
+{
+
+constexpr std::size_t MAX_VARINT_SIZE = 10;
+
+inline std::uint64_t zigzagEncode(std::int64_t value)
+{ return (((std::uint64_t) value) << 1) ^ (std::uint64_t) (value >> 63); }
+
+inline std::int64_t zigzagDecode(std::uint64_t value)
+{ return (std::int64_t) ((value >> 1) ^ (~(value & 1) + 1)); }
+
+// Returns the number of bytes of the LEB128 encoding of the given value.
+inline std::size_t varintSize(std::uint64_t value)
+{
+	// Each byte holds 7 bits, a value of zero still needs one byte.
+#if defined(__GNUC__) || defined(__clang__)
+	auto numBits = 64 - __builtin_clzll(value | 1);
+#else
+	int numBits = 1;
+	for (auto rest = value >> 1; rest != 0; rest >>= 1)
+		++numBits;
+#endif
+	return (std::size_t) (numBits + 6) / 7;
+}
+
+// Writes the LEB128 encoding of the value to dest which must provide varintSize(value) bytes.
+// Returns the number of bytes written.
+inline std::size_t encodeVarint(std::uint64_t value, std::uint8_t * dest)
+{
+	auto begin = dest;
+	for (; value >= 0x80; value >>= 7)
+		*dest++ = (std::uint8_t) ((value & 0x7f) | 0x80);
+	*dest++ = (std::uint8_t) value;
+	return (std::size_t) (dest - begin);
+}
+
+/**
+ * Decodes a LEB128 value from at most numBytes bytes.
+ * Returns the number of bytes consumed or 0 if the encoding is truncated or longer than MAX_VARINT_SIZE bytes.
+ * One and two byte encodings, which are the common case for small integers, take a fast path.
+ */
+inline std::size_t decodeVarint(const std::uint8_t * src, std::size_t numBytes, std::uint64_t & value)
+{
+	if (numBytes >= 1 && src[0] < 0x80)
+	{
+		value = src[0];
+		return 1;
+	}
+	if (numBytes >= 2 && src[1] < 0x80)
+	{
+		value = (src[0] & 0x7f) | ((std::uint64_t) src[1] << 7);
+		return 2;
+	}
+
+	std::uint64_t result = 0;
+	auto maxBytes = numBytes < MAX_VARINT_SIZE ? numBytes : MAX_VARINT_SIZE;
+	for (std::size_t i = 0; i < maxBytes; ++i)
+	{
+		result |= ((std::uint64_t) (src[i] & 0x7f)) << (7 * i);
+		if (src[i] < 0x80)
+		{
+			value = result;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Group varint encoding of 32 bit integers in the style of Stream VByte.
+ * Each value takes 1 to 4 little-endian data bytes. The lengths of four consecutive values are packed into one control
+ * byte (2 bits each, starting at the least significant bits). All control bytes precede all data bytes, so a decoder
+ * can expand four values at once with a single byte shuffle.
+ */
+namespace internal
+{
+
+inline std::size_t groupVarintLength(std::uint32_t value)
+{
+	return value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+}
+
+struct GroupVarintTables
+{
+	std::array<std::uint8_t, 256> dataSizes;
+	alignas(16) std::array<std::array<std::uint8_t, 16>, 256> shuffleMasks;
+
+	GroupVarintTables()
+	{
+		for (std::size_t control = 0; control < 256; ++control)
+		{
+			std::uint8_t offset = 0;
+			for (std::size_t i = 0; i < 4; ++i)
+			{
+				auto length = (std::uint8_t) (((control >> (2 * i)) & 3) + 1);
+				for (std::uint8_t byte = 0; byte < 4; ++byte)
+					shuffleMasks[control][4 * i + byte] = byte < length ? (std::uint8_t) (offset + byte) : 0x80;
+				offset += length;
+			}
+			dataSizes[control] = offset;
+		}
+	}
+};
+
+inline const GroupVarintTables & groupVarintTables()
+{
+	static const GroupVarintTables tables;
+	return tables;
+}
+
+inline std::uint32_t readGroupVarintValue(const std::uint8_t * src, std::size_t length)
+{
+	std::uint32_t value = 0;
+	for (std::size_t i = 0; i < length; ++i)
+		value |= ((std::uint32_t) src[i]) << (8 * i);
+	return value;
+}
+
+// Decodes numGroups full groups of four values. Returns the number of decoded values.
+inline std::size_t decodeGroupVarintScalar(const std::uint8_t *& control,
+                                           const std::uint8_t *& data,
+                                           std::uint32_t * values,
+                                           std::size_t numGroups)
+{
+	for (std::size_t group = 0; group < numGroups; ++group, ++control)
+	{
+		for (std::size_t i = 0; i < 4; ++i)
+		{
+			auto length = ((*control >> (2 * i)) & 3) + 1;
+			values[4 * group + i] = readGroupVarintValue(data, length);
+			data += length;
+		}
+	}
+	return numGroups * 4;
+}
+
+#ifdef ASIONET_VARINT_SIMD
+
+// Compiled for SSSE3 regardless of the global compiler flags and only called if the CPU supports it.
+__attribute__((target("ssse3")))
+inline std::size_t decodeGroupVarintSsse3(const std::uint8_t *& control,
+                                          const std::uint8_t *& data,
+                                          const std::uint8_t * dataEnd,
+                                          std::uint32_t * values,
+                                          std::size_t numGroups)
+{
+	const auto & tables = groupVarintTables();
+	std::size_t group = 0;
+	// Each group loads 16 bytes at once, although it may use less. The remaining groups are decoded by the scalar loop.
+	for (; group < numGroups && dataEnd - data >= 16; ++group, ++control)
+	{
+		auto mask = _mm_load_si128((const __m128i *) tables.shuffleMasks[*control].data());
+		auto bytes = _mm_loadu_si128((const __m128i *) data);
+		_mm_storeu_si128((__m128i *) (values + 4 * group), _mm_shuffle_epi8(bytes, mask));
+		data += tables.dataSizes[*control];
+	}
+	return 4 * group + decodeGroupVarintScalar(control, data, values + 4 * group, numGroups - group);
+}
+
+#endif
+
+}
+
+// Returns the maximum number of bytes needed to group varint encode numValues values.
+inline std::size_t groupVarintMaxSize(std::size_t numValues)
+{ return (numValues + 3) / 4 + 4 * numValues; }
+
+// Writes the group varint encoding of the values to dest which must provide groupVarintMaxSize(numValues) bytes.
+// Returns the number of bytes written.
+inline std::size_t encodeGroupVarint(const std::uint32_t * values, std::size_t numValues, std::uint8_t * dest)
+{
+	auto control = dest;
+	auto numControlBytes = (numValues + 3) / 4;
+	std::memset(control, 0, numControlBytes);
+	auto data = dest + numControlBytes;
+	for (std::size_t i = 0; i < numValues; ++i)
+	{
+		auto value = values[i];
+		auto length = internal::groupVarintLength(value);
+		control[i / 4] |= (std::uint8_t) ((length - 1) << (2 * (i % 4)));
+		for (std::size_t byte = 0; byte < length; ++byte)
+			*data++ = (std::uint8_t) (value >> (8 * byte));
+	}
+	return (std::size_t) (data - dest);
+}
+
+/**
+ * Decodes numValues group varint encoded values from at most numBytes bytes.
+ * Returns the number of bytes consumed or 0 if the encoding is truncated.
+ * On x86-64 CPUs with SSSE3, four values are decoded at once by a byte shuffle.
+ */
+inline std::size_t decodeGroupVarint(const std::uint8_t * src,
+                                     std::size_t numBytes,
+                                     std::uint32_t * values,
+                                     std::size_t numValues)
+{
+	auto numControlBytes = (numValues + 3) / 4;
+	if (numBytes < numControlBytes)
+		return 0;
+
+	// Validate the total length up front, so the decoding loops don't need any bounds checks.
+	const auto & tables = internal::groupVarintTables();
+	auto numGroups = numValues / 4;
+	std::size_t dataSize = 0;
+	for (std::size_t i = 0; i < numGroups; ++i)
+		dataSize += tables.dataSizes[src[i]];
+	for (std::size_t i = numGroups * 4; i < numValues; ++i)
+		dataSize += ((src[numGroups] >> (2 * (i % 4))) & 3) + 1;
+	if (numBytes - numControlBytes < dataSize)
+		return 0;
+
+	auto control = src;
+	auto data = src + numControlBytes;
+	std::size_t numDecoded;
+#ifdef ASIONET_VARINT_SIMD
+	if (internal::hasSsse3())
+		numDecoded = internal::decodeGroupVarintSsse3(control, data, data + dataSize, values, numGroups);
+	else
+#endif
+		numDecoded = internal::decodeGroupVarintScalar(control, data, values, numGroups);
+
+	for (std::size_t i = numDecoded; i < numValues; ++i)
+	{
+		auto length = ((*control >> (2 * (i % 4))) & 3) + 1;
+		values[i] = internal::readGroupVarintValue(data, length);
+		data += length;
+	}
+	return numControlBytes + dataSize;
+}
+
+}
+}
+
+#endif //ASIONET_VARINT_H
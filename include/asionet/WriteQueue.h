@@ -0,0 +1,169 @@
+/*
+ * The MIT License
+ * 
+ * Copyright (c) 2019 Philipp Badenhoop
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ASIONET_WRITEQUEUE_H
+#define ASIONET_WRITEQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <boost/asio/write.hpp>
+#include "Stream.h"
+
+namespace asionet
+{
+namespace stream
+{
+
+/**
+ * Outgoing frame queue of a single stream.
+ * Frames which are written while a previous write is still in progress are queued and written together
+ * with a single scatter-gather write (i.e. one writev() call instead of one per frame) as soon as the stream is ready.
+ * A batch collects pending frames until their total size would exceed maxBatchSize. A frame which is larger than
+ * maxBatchSize is written in a batch of its own.
+ *
+ * Since all frames of a batch share a single asynchronous write, they also share a single timeout which is the largest
+ * timeout of the batch's frames. If that timeout expires, the stream is closed and all frames of the batch fail.
+ *
+ * Just like for stream::asyncWrite(), the caller must keep writeData alive until the handler is called.
+ * The WriteQueue object itself must outlive all of its pending operations.
+ */
+template<typename SyncWriteStream>
+class WriteQueue
+{
+public:
+	explicit WriteQueue(SyncWriteStream & stream, std::size_t maxBatchSize = 0x10000)
+		: stream(stream), maxBatchSize(maxBatchSize)
+	{}
+
+	WriteQueue(const WriteQueue &) = delete;
+
+	WriteQueue & operator=(const WriteQueue &) = delete;
+
+	void asyncWrite(const std::string & writeData,
+	                const time::Duration & timeout,
+	                WriteHandler handler,
+	                bool checksum = false)
+	{
+		if (writeData.size() > asionet::internal::Frame::MAX_DATA_SIZE)
+		{
+			// The size would overflow into the header's flags.
+			stream.get_executor().context().post([handler] { handler(error::encoding); });
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock{mutex};
+		pendingWrites.push_back(std::make_unique<PendingWrite>(writeData, timeout, std::move(handler), checksum));
+		if (writing)
+			return;
+
+		writing = true;
+		writeNextBatch(lock);
+	}
+
+	SyncWriteStream & getStream()
+	{
+		return stream;
+	}
+
+	std::size_t getMaxBatchSize() const
+	{
+		return maxBatchSize;
+	}
+
+private:
+	struct PendingWrite
+	{
+		PendingWrite(const std::string & writeData,
+		             const time::Duration & timeout,
+		             WriteHandler && handler,
+		             bool checksum)
+			: frame((const std::uint8_t *) writeData.c_str(), writeData.size(), checksum)
+			  , timeout(timeout)
+			  , handler(std::move(handler))
+		{}
+
+		asionet::internal::Frame frame;
+		time::Duration timeout;
+		WriteHandler handler;
+	};
+
+	using Batch = std::vector<std::unique_ptr<PendingWrite>>;
+
+	SyncWriteStream & stream;
+	std::size_t maxBatchSize;
+	std::mutex mutex;
+	std::deque<std::unique_ptr<PendingWrite>> pendingWrites;
+	bool writing{false};
+
+	// Must be called with a locked mutex and at least one pending write. Releases the lock.
+	void writeNextBatch(std::unique_lock<std::mutex> & lock)
+	{
+		auto batch = std::make_shared<Batch>();
+		std::size_t batchSize{0};
+		auto timeout = pendingWrites.front()->timeout;
+
+		while (!pendingWrites.empty())
+		{
+			auto frameSize = pendingWrites.front()->frame.getSize();
+			if (!batch->empty() && batchSize + frameSize > maxBatchSize)
+				break;
+
+			batchSize += frameSize;
+			timeout = std::max(timeout, pendingWrites.front()->timeout);
+			batch->push_back(std::move(pendingWrites.front()));
+			pendingWrites.pop_front();
+		}
+
+		lock.unlock();
+
+		std::vector<boost::asio::const_buffer> buffers;
+		buffers.reserve(3 * batch->size());
+		for (const auto & pendingWrite : *batch)
+			pendingWrite->frame.appendBuffers(buffers);
+
+		auto asyncOperation = [](auto && ... args) { boost::asio::async_write(std::forward<decltype(args)>(args)...); };
+
+		closeable::timedAsyncOperation(
+			asyncOperation, stream, timeout,
+			[this, batch = std::move(batch), batchSize](const auto & error, auto numBytesTransferred)
+			{
+				auto batchError = numBytesTransferred < batchSize ? error::failedOperation : error;
+				for (const auto & pendingWrite : *batch)
+					pendingWrite->handler(batchError);
+
+				std::unique_lock<std::mutex> lock{mutex};
+				if (pendingWrites.empty())
+				{
+					writing = false;
+					return;
+				}
+				this->writeNextBatch(lock);
+			},
+			stream, buffers);
+	}
+};
+
+}
+}
+
+#endif //ASIONET_WRITEQUEUE_H
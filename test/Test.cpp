@@ -25,20 +25,53 @@
 #include "TestUtils.h"
 #include <boost/asio/ip/tcp.hpp>
 #include <iostream>
+#include <set>
 #include "../include/asionet/ServiceServer.h"
 #include "TestService.h"
 #include "../include/asionet/ServiceClient.h"
+#include "../include/asionet/ServiceProxy.h"
 #include "../include/asionet/DatagramReceiver.h"
 #include "../include/asionet/DatagramSender.h"
+#include "../include/asionet/DeltaDatagram.h"
+#include "../include/asionet/ShardedDatagramReceiver.h"
+#include "../include/asionet/Fragmentation.h"
 #include "../include/asionet/Worker.h"
 #include "../include/asionet/WorkerPool.h"
 #include "../include/asionet/WorkSerializer.h"
 #include "../include/asionet/ConstBuffer.h"
+#include "../include/asionet/BinaryCodec.h"
+#include "../include/asionet/TrivialCodec.h"
+#include "../include/asionet/VariantCodec.h"
+#include "../include/asionet/ByteOrder.h"
 #include <gtest/gtest.h>
+#include <cstdlib>
+#include <new>
 
 using boost::asio::ip::tcp;
 
 using namespace std::chrono_literals;
+
+// Counts the heap allocations of the current thread and their bytes while countAllocations is set.
+thread_local bool countAllocations{false};
+thread_local std::size_t numAllocations{0};
+thread_local std::size_t numAllocatedBytes{0};
+
+void * operator new(std::size_t size)
+{
+	if (countAllocations)
+	{
+		++numAllocations;
+		numAllocatedBytes += size;
+	}
+	if (auto memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void * memory) noexcept
+{
+	std::free(memory);
+}
 using namespace protocol;
 
 namespace asionet
@@ -623,6 +656,312 @@ TEST(asionetTest, LargeTransferSize)
 	runTest1<LargeTransferSize>();
 }
 
+struct CoalescedWrites : std::enable_shared_from_this<CoalescedWrites>
+{
+	boost::asio::ip::tcp::acceptor acceptor;
+	boost::asio::ip::tcp::socket serverSocket;
+	boost::asio::ip::tcp::socket clientSocket;
+	stream::WriteQueue<boost::asio::ip::tcp::socket> writeQueue;
+	boost::asio::streambuf buffer;
+	Waiter waiter;
+
+	CoalescedWrites(asionet::Context & context)
+		: acceptor(context, tcp::endpoint{tcp::v4(), 10000})
+		  , serverSocket(context)
+		  , clientSocket(context)
+		  , writeQueue(clientSocket, 64)
+		  , waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		constexpr std::size_t numMessages{100};
+		std::atomic<std::size_t> sentMessages{0};
+		std::size_t receivedMessages{0};
+		Waitable sent{waiter}, received{waiter};
+
+		clientSocket.connect(tcp::endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10000});
+		acceptor.accept(serverSocket);
+
+		message::ReceiveHandler<TestMessage> receiveHandler =
+			[&, self](const auto & error, auto & message)
+			{
+				EXPECT_FALSE(error);
+				EXPECT_EQ(message.getValue(), receivedMessages); // correct order
+				receivedMessages++;
+				if (receivedMessages == numMessages)
+				{
+					received.setReady();
+					return;
+				}
+				message::asyncReceive<TestMessage>(serverSocket, buffer, 1s, receiveHandler);
+			};
+
+		message::asyncReceive<TestMessage>(serverSocket, buffer, 1s, receiveHandler);
+
+		for (std::size_t i = 0; i < numMessages; ++i)
+		{
+			message::asyncSend(
+				writeQueue, TestMessage::response(1, i), 1s,
+				[&, self](const auto & error)
+				{
+					EXPECT_FALSE(error);
+					if (++sentMessages == numMessages)
+						sent.setReady();
+				});
+		}
+
+		// The send handlers may still be pending after the last message has been received.
+		waiter.await(sent && received);
+		EXPECT_EQ(sentMessages, numMessages);
+		EXPECT_EQ(receivedMessages, numMessages);
+	}
+};
+
+TEST(asionetTest, CoalescedWrites)
+{
+	runTest1<CoalescedWrites>();
+}
+
+struct ChunkedTransfer : std::enable_shared_from_this<ChunkedTransfer>
+{
+	static constexpr std::size_t chunkSize = 0x1000;
+	static constexpr std::size_t numChunks = 256;
+	boost::asio::ip::tcp::acceptor acceptor;
+	boost::asio::ip::tcp::socket serverSocket;
+	boost::asio::ip::tcp::socket clientSocket;
+	boost::asio::streambuf buffer{chunkSize + internal::Frame::HEADER_SIZE};
+	Waiter waiter;
+
+	ChunkedTransfer(asionet::Context & context)
+		: acceptor(context, tcp::endpoint{tcp::v4(), 10000})
+		  , serverSocket(context)
+		  , clientSocket(context)
+		  , waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::size_t chunksWritten{0};
+		std::uint64_t progress{0};
+		Waitable sent{waiter}, received{waiter};
+
+		clientSocket.connect(tcp::endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10000});
+		acceptor.accept(serverSocket);
+
+		message::asyncReceiveChunked<std::string>(
+			serverSocket, buffer, 1s,
+			received([&, self](const auto & error, auto & message)
+			         {
+				         EXPECT_FALSE(error);
+				         EXPECT_EQ(message.size(), chunkSize * numChunks);
+				         EXPECT_EQ(message.back(), 'a' + (numChunks - 1) % 26);
+			         }),
+			[&, self](auto numBytesReceived) { progress = numBytesReceived; });
+
+		stream::asyncWriteChunked(
+			clientSocket,
+			[&, self](auto & chunk)
+			{
+				if (chunksWritten == numChunks)
+					return false;
+				chunk.assign(chunkSize, 'a' + chunksWritten++ % 26);
+				return true;
+			},
+			1s,
+			sent([&, self](const auto & error, auto numBytesWritten)
+			     {
+				     EXPECT_FALSE(error);
+				     EXPECT_EQ(numBytesWritten, chunkSize * numChunks);
+			     }));
+
+		waiter.await(sent && received);
+		EXPECT_EQ(progress, chunkSize * numChunks);
+	}
+};
+
+TEST(asionetTest, ChunkedTransfer)
+{
+	runTest1<ChunkedTransfer>();
+}
+
+struct PausedChunkedTransfer : std::enable_shared_from_this<PausedChunkedTransfer>
+{
+	static constexpr std::size_t chunkSize = 0x1000;
+	static constexpr std::size_t numChunks = 64;
+	boost::asio::ip::tcp::acceptor acceptor;
+	boost::asio::ip::tcp::socket serverSocket;
+	boost::asio::ip::tcp::socket clientSocket;
+	boost::asio::streambuf buffer{chunkSize + internal::Frame::HEADER_SIZE};
+	boost::asio::steady_timer resumeTimer;
+	Waiter waiter;
+
+	PausedChunkedTransfer(asionet::Context & context)
+		: acceptor(context, tcp::endpoint{tcp::v4(), 10000})
+		  , serverSocket(context)
+		  , clientSocket(context)
+		  , resumeTimer(context)
+		  , waiter(context)
+	{}
+
+	void write(std::size_t numChunksToWrite, Waitable & sent)
+	{
+		auto self = shared_from_this();
+		auto chunksWritten = std::make_shared<std::size_t>(0);
+		stream::asyncWriteChunked(
+			clientSocket,
+			[self, chunksWritten, numChunksToWrite](auto & chunk)
+			{
+				if (*chunksWritten == numChunksToWrite)
+					return false;
+				chunk.assign(chunkSize, 'a' + (*chunksWritten)++ % 26);
+				return true;
+			},
+			1s,
+			sent([self](const auto & error, auto numBytesWritten) { EXPECT_FALSE(error); }));
+	}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::size_t numPauses{0};
+		std::atomic<bool> paused{false};
+		std::string expected;
+		for (std::size_t i = 0; i < numChunks; ++i)
+			expected.append(chunkSize, 'a' + i % 26);
+
+		clientSocket.connect(tcp::endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10000});
+		acceptor.accept(serverSocket);
+
+		Waitable sent{waiter}, received{waiter};
+		message::asyncReceiveChunkedPausable<std::string>(
+			serverSocket, buffer, 1s,
+			received([&, self](const auto & error, auto & message)
+			         {
+				         EXPECT_FALSE(error);
+				         EXPECT_TRUE(message == expected);
+			         }),
+			[&, self](auto numBytesReceived, const auto & resume)
+			{
+				// No chunk must arrive while the transfer is paused.
+				EXPECT_FALSE(paused);
+				numPauses++;
+				// Resuming right away must not let the next read overtake consuming the current chunk.
+				if (numPauses % 2 == 0)
+				{
+					resume();
+					return;
+				}
+
+				paused = true;
+				resumeTimer.expires_after(1ms);
+				resumeTimer.async_wait([&, self, resume](const auto & error)
+				                       {
+					                       paused = false;
+					                       resume();
+				                       });
+			});
+		write(numChunks, sent);
+		waiter.await(sent && received);
+		EXPECT_EQ(numPauses, std::size_t{numChunks});
+
+		// Without a progress handler, the chunks are received one after another.
+		Waitable sentAgain{waiter}, receivedAgain{waiter};
+		message::asyncReceiveChunked<std::string>(
+			serverSocket, buffer, 1s,
+			receivedAgain([&, self](const auto & error, auto & message)
+			              {
+				              EXPECT_FALSE(error);
+				              EXPECT_EQ(message.size(), 2 * chunkSize);
+			              }),
+			nullptr);
+		write(2, sentAgain);
+		waiter.await(sentAgain && receivedAgain);
+	}
+};
+
+TEST(asionetTest, PausedChunkedTransfer)
+{
+	runTest1<PausedChunkedTransfer>(4);
+}
+
+struct ChecksumService : std::enable_shared_from_this<ChecksumService>
+{
+	ServiceServer<StringService> server;
+	ServiceClient<StringService> client;
+	Waiter waiter;
+
+	ChecksumService(Context & context)
+		: server(context, 10000)
+		  , client(context)
+		  , waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		server.enableChecksum();
+		client.enableChecksum();
+		server.advertiseService(
+			[&, self](const auto & endpoint, const auto & request, auto & response)
+			{
+				EXPECT_EQ(request, "Ping");
+				response = std::string{"Pong"};
+			});
+		Waitable waitable{waiter};
+		client.asyncCall("Ping", "127.0.0.1", 10000, 1s,
+		                 waitable([&, self](const auto & error, const auto & resp)
+		                          {
+			                          EXPECT_FALSE(error);
+			                          EXPECT_EQ(resp, "Pong");
+		                          }));
+		waiter.await(waitable);
+	}
+};
+
+TEST(asionetTest, ChecksumService)
+{
+	runTest1<ChecksumService>();
+}
+
+struct CorruptedDatagram : std::enable_shared_from_this<CorruptedDatagram>
+{
+	DatagramReceiver<std::string> receiver;
+	boost::asio::ip::udp::socket socket;
+	Waiter waiter;
+
+	CorruptedDatagram(asionet::Context & context)
+		: receiver(context, 10000)
+		  , socket(context, boost::asio::ip::udp::v4())
+		  , waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::string data{"Hello World!"};
+		internal::Frame frame{(const std::uint8_t *) data.c_str(), (std::uint32_t) data.size(), true};
+		std::vector<char> bytes;
+		for (const auto & buffer : frame.getBuffers())
+			bytes.insert(bytes.end(), (const char *) buffer.data(), (const char *) buffer.data() + buffer.size());
+		bytes[internal::Frame::HEADER_SIZE] ^= 0x01;
+
+		Waitable waitable{waiter};
+		receiver.asyncReceive(1s, waitable([&, self](const auto & error, auto && ... args)
+		                                   { EXPECT_EQ(error, error::invalidFrame); }));
+		socket.send_to(boost::asio::buffer(bytes),
+		               boost::asio::ip::udp::endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10000});
+		waiter.await(waitable);
+	}
+};
+
+TEST(asionetTest, CorruptedDatagram)
+{
+	runTest1<CorruptedDatagram>();
+}
+
 // --- ATTENTION ---
 // The following tests must be checked manually.
 
@@ -676,6 +1015,7 @@ TEST(asionetTest, ConstStreamBuffer)
 	EXPECT_EQ(buffer[4], 'o');
 	std::string o{buffer.begin(), buffer.end()};
 	EXPECT_EQ(o, s);
+	EXPECT_EQ(std::string(buffer.data(), buffer.size()), s);
 }
 
 TEST(asionetTest, ConstVectorBuffer)
@@ -686,6 +1026,1806 @@ TEST(asionetTest, ConstVectorBuffer)
 	EXPECT_EQ(buffer[2], 'C');
 	std::string o{buffer.begin(), buffer.end()};
 	EXPECT_EQ(o, std::string{"ABC"});
+	EXPECT_EQ(buffer.data(), v.data() + 4);
+}
+
+TEST(asionetTest, Crc32c)
+{
+	std::string data{"123456789"};
+	EXPECT_EQ(utils::crc32c(data.c_str(), data.size()), 0xe3069283);
+	EXPECT_EQ(utils::internal::crc32cSoftware(~0u, (const std::uint8_t *) data.c_str(), data.size()), ~0xe3069283);
+	auto crc = utils::crc32c(data.c_str(), 4);
+	EXPECT_EQ(utils::crc32c(data.c_str() + 4, data.size() - 4, crc), 0xe3069283);
+}
+
+
+struct SharedBytesDatagram : std::enable_shared_from_this<SharedBytesDatagram>
+{
+	DatagramReceiver<SharedBytes> receiver;
+	DatagramSender<SharedBytes> sender;
+	Waiter waiter;
+	SharedBytes first, second;
+
+	SharedBytesDatagram(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		Waitable waitable1{waiter}, waitable2{waiter};
+		receiver.asyncReceive(
+			1s,
+			waitable1([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			          {
+				          EXPECT_FALSE(error);
+				          first = message;
+			          }));
+		sender.asyncSend(SharedBytes::copy("first", 5), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(waitable1);
+
+		receiver.asyncReceive(
+			1s,
+			waitable2([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			          {
+				          EXPECT_FALSE(error);
+				          second = message;
+			          }));
+		sender.asyncSend(SharedBytes::copy("second", 6), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(waitable2);
+
+		// The first message still owns its receive buffer, so the second one must have been received into another one.
+		EXPECT_EQ(std::string(first.begin(), first.end()), "first");
+		EXPECT_EQ(std::string(second.begin(), second.end()), "second");
+		EXPECT_NE(first.getBlock(), second.getBlock());
+	}
+};
+
+TEST(asionetTest, SharedBytesDatagram)
+{
+	runTest1<SharedBytesDatagram>();
+}
+
+TEST(asionetTest, ObjectPool)
+{
+	utils::ObjectPool<std::string> pool{1, [](std::string & s) { s.clear(); }};
+	auto s1 = pool.acquire();
+	auto s2 = pool.acquire();
+	*s1 = "recycled";
+	auto * address = s1.get();
+	s1.reset();
+	s2.reset();
+	EXPECT_EQ(pool.getNumPooledObjects(), 1);
+	auto s3 = pool.acquire();
+	EXPECT_EQ(s3.get(), address);
+	EXPECT_TRUE(s3->empty());
+	EXPECT_EQ(pool.getNumPooledObjects(), 0);
+}
+
+
+enum class Color : std::uint8_t { red, green };
+
+struct CodecPoint
+{
+	std::uint16_t x;
+	float y;
+	ASIONET_FIELDS(x, y)
+};
+
+struct CodecRecord
+{
+	std::int32_t id;
+	std::uint64_t count;
+	std::int64_t delta;
+	double ratio;
+	bool flag;
+	Color color;
+	std::string name;
+	std::vector<CodecPoint> points;
+	std::vector<std::uint8_t> blob;
+	std::vector<bool> flags;
+	ASIONET_FIELDS(id, codec::varint(count), codec::varint(delta), ratio, flag, color, name, points, blob, flags)
+};
+
+TEST(asionetTest, BinaryCodec)
+{
+	CodecRecord record{-7, 300, -2, 0.25, true, Color::green, "name", {{1, 1.5f}, {2, -2.5f}}, {0xde, 0xad},
+	                    {true, false, true}};
+	std::string data;
+	message::Encoder<CodecRecord>{}(record, data);
+	EXPECT_EQ(data.size(), 4 + 2 + 1 + 8 + 1 + 1 + 5 + 13 + 3 + 4);
+	// 300 is encoded as varint 0xac 0x02, -2 is zigzag encoded as 3.
+	EXPECT_EQ(data.substr(4, 3), std::string("\xac\x02\x03"));
+
+	std::vector<char> bytes{data.begin(), data.end()};
+	CodecRecord decoded{};
+	message::Decoder<CodecRecord>{}(internal::ConstVectorBuffer{bytes, bytes.size(), 0}, decoded);
+	EXPECT_EQ(decoded.id, -7);
+	EXPECT_EQ(decoded.count, 300);
+	EXPECT_EQ(decoded.delta, -2);
+	EXPECT_EQ(decoded.ratio, 0.25);
+	EXPECT_TRUE(decoded.flag);
+	EXPECT_EQ(decoded.color, Color::green);
+	EXPECT_EQ(decoded.name, "name");
+	ASSERT_EQ(decoded.points.size(), 2);
+	EXPECT_EQ(decoded.points[1].x, 2);
+	EXPECT_EQ(decoded.points[1].y, -2.5f);
+	EXPECT_EQ(decoded.blob, (std::vector<std::uint8_t>{0xde, 0xad}));
+	EXPECT_EQ(decoded.flags, (std::vector<bool>{true, false, true}));
+
+	EXPECT_THROW(message::Decoder<CodecRecord>{}(internal::ConstVectorBuffer{bytes, bytes.size() - 1, 0}, decoded),
+	             std::runtime_error);
+}
+
+
+struct Telemetry
+{
+	std::uint32_t id;
+	double values[3];
+};
+
+struct TrivialDatagram : std::enable_shared_from_this<TrivialDatagram>
+{
+	DatagramReceiver<Telemetry> receiver;
+	DatagramSender<Telemetry> sender;
+	Waiter waiter;
+
+	TrivialDatagram(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		Waitable waitable{waiter};
+		receiver.asyncReceive(
+			1s,
+			waitable([self](const auto & error, auto & message, const auto & senderEndpoint)
+			         {
+				         EXPECT_FALSE(error);
+				         EXPECT_EQ(message.id, 42);
+				         EXPECT_EQ(message.values[2], 3.5);
+			         }));
+		sender.asyncSend(Telemetry{42, {1.5, 2.5, 3.5}}, "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(waitable);
+	}
+};
+
+TEST(asionetTest, TrivialDatagram)
+{
+	runTest1<TrivialDatagram>();
+}
+
+TEST(asionetTest, TrivialCodec)
+{
+	std::string data;
+	message::Encoder<std::vector<std::uint16_t>>{}({0x0102, 0x0304}, data);
+	EXPECT_EQ(data, std::string("\x01\x02\x03\x04"));
+
+	std::vector<char> bytes{data.begin(), data.end()};
+	std::uint32_t value = 0;
+	message::Decoder<std::uint32_t>{}(internal::ConstVectorBuffer{bytes, bytes.size(), 0}, value);
+	EXPECT_EQ(value, 0x01020304);
+	EXPECT_THROW(message::Decoder<std::uint32_t>{}(internal::ConstVectorBuffer{bytes, 3, 0}, value),
+	             std::runtime_error);
+
+	std::vector<bool> flags{true, false, true};
+	message::Encoder<std::vector<bool>>{}(flags, data);
+	EXPECT_EQ(data, std::string("\x01\x00\x01", 3));
+	bytes.assign(data.begin(), data.end());
+	std::vector<bool> decodedFlags;
+	message::Decoder<std::vector<bool>>{}(internal::ConstVectorBuffer{bytes, bytes.size(), 0}, decodedFlags);
+	EXPECT_EQ(decodedFlags, flags);
+
+	std::vector<long double> numbers{1.5L, -2.25L};
+	message::Encoder<std::vector<long double>>{}(numbers, data);
+	bytes.assign(data.begin(), data.end());
+	std::vector<long double> decodedNumbers;
+	message::Decoder<std::vector<long double>>{}(internal::ConstVectorBuffer{bytes, bytes.size(), 0}, decodedNumbers);
+	EXPECT_EQ(decodedNumbers, numbers);
+}
+
+
+struct VariantDatagram : std::enable_shared_from_this<VariantDatagram>
+{
+	using Variant = boost::variant<TestMessage, std::string, SharedBytes>;
+
+	DatagramReceiver<Variant> receiver;
+	DatagramSender<Variant> sender;
+	Waiter waiter;
+	std::vector<std::string> received;
+
+	VariantDatagram(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void receive(Waitable & waitable)
+	{
+		auto self = shared_from_this();
+		receiver.asyncReceive(
+			1s,
+			waitable([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			         {
+				         EXPECT_FALSE(error);
+				         boost::apply_visitor(utils::overload(
+					         [&](const TestMessage & m) { received.push_back(std::to_string(m.getId())); },
+					         [&](const std::string & s) { received.push_back(s); },
+					         [&](const SharedBytes & b) { received.push_back(std::string(b.begin(), b.end())); }),
+				                              message);
+			         }));
+	}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::vector<Variant> messages{std::string{"hello"}, TestMessage::request(42), SharedBytes::copy("bytes", 5)};
+		for (const auto & message : messages)
+		{
+			Waitable waitable{waiter};
+			receive(waitable);
+			sender.asyncSend(message, "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+			waiter.await(waitable);
+		}
+		EXPECT_EQ(received, (std::vector<std::string>{"hello", "42", "bytes"}));
+	}
+};
+
+TEST(asionetTest, VariantDatagram)
+{
+	runTest1<VariantDatagram>();
+}
+
+
+TEST(asionetTest, VariantEncoding)
+{
+	using Variant = boost::variant<TestMessage, CodecRecord, std::string>;
+	CodecRecord record{-7, 300, -2, 0.25, true, Color::green, "name", {{1, 1.5f}, {2, -2.5f}}, {0xde, 0xad},
+	                    {true, false, true}};
+	std::string recordData;
+	message::Encoder<CodecRecord>{}(record, recordData);
+	std::string testMessageData;
+	message::Encoder<TestMessage>{}(TestMessage::request(42), testMessageData);
+
+	std::string data;
+	data.reserve(256);
+	message::Encoder<Variant>{}(Variant{TestMessage::request(42)}, data);
+	EXPECT_EQ(data, '\0' + testMessageData);
+
+	// The alternatives are encoded behind the type index into the buffer which is already there.
+	Variant message{record};
+	auto numAllocationsBefore = numAllocations;
+	countAllocations = true;
+	message::Encoder<Variant>{}(message, data);
+	countAllocations = false;
+	EXPECT_EQ(numAllocations, numAllocationsBefore);
+	EXPECT_EQ(data, '\1' + recordData);
+}
+
+
+TEST(asionetTest, EncodeBufferPool)
+{
+	message::internal::EncodeBufferPool pool;
+	auto data = pool.acquire();
+	message::internal::encode(std::string(1000, 'x'), *data);
+	auto capacity = data->capacity();
+	data.reset();
+	data = pool.acquire();
+	EXPECT_TRUE(data->empty());
+	EXPECT_EQ(data->capacity(), capacity);
+
+	data->resize(message::internal::MAX_POOLED_ENCODE_BUFFER_CAPACITY + 1);
+	data.reset();
+	EXPECT_LE(pool.acquire()->capacity(), message::internal::MAX_POOLED_ENCODE_BUFFER_CAPACITY);
+
+	// Once warmed up, encoding a message into a pooled buffer and releasing it doesn't allocate.
+	TestMessage message = TestMessage::request(42);
+	auto send = [&]
+	{
+		auto data = pool.acquire();
+		message::internal::encode(message, *data);
+		std::shared_ptr<const std::string> encoded{std::move(data)};
+	};
+	send();
+	countAllocations = true;
+	for (int i = 0; i < 100; ++i)
+		send();
+	countAllocations = false;
+	EXPECT_EQ(numAllocations, 0);
+}
+
+
+struct RawDatagram : std::enable_shared_from_this<RawDatagram>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	RawDatagram(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		Waitable waitable{waiter};
+		receiver.asyncReceiveRaw(
+			1s,
+			waitable([self](const auto & error, const auto & rawMessage, const auto & senderEndpoint)
+			         {
+				         EXPECT_FALSE(error);
+				         ASSERT_EQ(rawMessage.size(), 9);
+				         // Peek at the message type without decoding the whole message.
+				         EXPECT_EQ(rawMessage[4], messageTypes::REQUEST);
+				         EXPECT_EQ(rawMessage.share().size(), 9);
+				         TestMessage message;
+				         EXPECT_TRUE(rawMessage.decode(message));
+				         EXPECT_EQ(message.getId(), 42);
+			         }));
+		sender.asyncSend(TestMessage::request(42), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(waitable);
+	}
+};
+
+TEST(asionetTest, RawDatagram)
+{
+	runTest1<RawDatagram>();
+}
+
+struct RawService : std::enable_shared_from_this<RawService>
+{
+	ServiceServer<TestService> server;
+	ServiceClient<TestService> client;
+	Waiter waiter;
+
+	RawService(asionet::Context & context)
+		: server(context, 10000)
+		, client(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		server.advertiseRawService(
+			[self](const auto & clientEndpoint, const auto & rawRequest, auto & response)
+			{
+				// Answer with the first byte of the encoded request id.
+				response = TestMessage::response(42, (Value) rawRequest[0]);
+			});
+
+		Waitable waitable{waiter};
+		client.asyncCall(TestMessage::request(7), "127.0.0.1", 10000, 1s,
+		                 waitable([self](const auto & error, const auto & response)
+		                          {
+			                          EXPECT_FALSE(error);
+			                          EXPECT_EQ(response.getValue(), 7);
+		                          }));
+		waiter.await(waitable);
+	}
+};
+
+TEST(asionetTest, RawService)
+{
+	runTest1<RawService>();
+}
+
+
+TEST(asionetTest, ByteOrder)
+{
+	// Use an odd number of elements to cover both the vectorized loop and the scalar remainder.
+	std::vector<std::uint32_t> values(37);
+	for (std::size_t i = 0; i < values.size(); ++i)
+		values[i] = (std::uint32_t) (0x01020304 * (i + 1));
+	auto expected = values;
+
+	auto converted = values;
+	utils::hostToBigEndian(converted.data(), converted.size());
+	for (std::size_t i = 0; i < values.size(); ++i)
+		EXPECT_EQ((utils::fromBigEndian<4, std::uint32_t>((const std::uint8_t *) &converted[i])), values[i]);
+
+	utils::bigEndianToHost(converted.data(), converted.size());
+	EXPECT_EQ(converted, expected);
+
+	std::vector<std::uint64_t> values64{0x0102030405060708, 0x1112131415161718, 0x2122232425262728};
+	utils::swapByteOrder<8>(values64.data(), values64.size());
+	EXPECT_EQ(values64[2], 0x2827262524232221);
+
+	// Other sizes, like the 16 bytes of a long double on x86-64, are reversed as well.
+	std::array<char, 16> bytes16{{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15}};
+	utils::swapByteOrder<16>(bytes16.data(), 1);
+	EXPECT_EQ(bytes16[0], 15);
+	EXPECT_EQ(bytes16[15], 0);
+
+	std::vector<std::uint16_t> values16(21, 0x0102);
+	utils::internal::swapByteOrderScalar<2>((char *) values16.data(), values16.size());
+	EXPECT_EQ(values16[20], 0x0201);
+#ifdef ASIONET_BYTEORDER_SIMD
+	if (utils::internal::hasSsse3())
+	{
+		utils::internal::swapByteOrderSsse3<2>((char *) values16.data(), values16.size());
+		EXPECT_EQ(values16[0], 0x0102);
+		EXPECT_EQ(values16[20], 0x0102);
+	}
+#endif
+}
+
+
+struct CodecCounters
+{
+	std::vector<std::uint32_t> counters;
+	ASIONET_FIELDS(codec::groupVarint(counters))
+};
+
+TEST(asionetTest, Varint)
+{
+	std::uint8_t bytes[utils::MAX_VARINT_SIZE];
+	for (std::uint64_t value : {0ull, 127ull, 128ull, 16383ull, 16384ull, 0xffffffffffffffffull})
+	{
+		auto numBytes = utils::encodeVarint(value, bytes);
+		EXPECT_EQ(numBytes, utils::varintSize(value));
+		std::uint64_t decoded;
+		EXPECT_EQ(utils::decodeVarint(bytes, numBytes, decoded), numBytes);
+		EXPECT_EQ(decoded, value);
+		if (numBytes > 1)
+		{
+			EXPECT_EQ(utils::decodeVarint(bytes, numBytes - 1, decoded), 0);
+		}
+	}
+	EXPECT_EQ(utils::zigzagEncode(-1), 1);
+	EXPECT_EQ(utils::zigzagEncode(1), 2);
+	EXPECT_EQ(utils::zigzagDecode(utils::zigzagEncode(-123456789)), -123456789);
+
+	// An odd number of values covers the shuffle loop, the scalar groups and the partial last group.
+	std::vector<std::uint32_t> values(103);
+	for (std::size_t i = 0; i < values.size(); ++i)
+		values[i] = (std::uint32_t) (i * i * i * 4001);
+	std::vector<std::uint8_t> encoded(utils::groupVarintMaxSize(values.size()));
+	auto numBytes = utils::encodeGroupVarint(values.data(), values.size(), encoded.data());
+	std::vector<std::uint32_t> decoded(values.size());
+	EXPECT_EQ(utils::decodeGroupVarint(encoded.data(), numBytes, decoded.data(), decoded.size()), numBytes);
+	EXPECT_EQ(decoded, values);
+	EXPECT_EQ(utils::decodeGroupVarint(encoded.data(), numBytes - 1, decoded.data(), decoded.size()), 0);
+
+	CodecCounters counters{values}, decodedCounters;
+	std::string data;
+	message::Encoder<CodecCounters>{}(counters, data);
+	std::vector<char> buffer{data.begin(), data.end()};
+	message::Decoder<CodecCounters>{}(internal::ConstVectorBuffer{buffer, buffer.size(), 0}, decodedCounters);
+	EXPECT_EQ(decodedCounters.counters, values);
+}
+
+
+struct PreEncodedRequest : std::enable_shared_from_this<PreEncodedRequest>
+{
+	ServiceServer<TestService> server;
+	ServiceClient<TestService> client;
+	DatagramReceiver<std::string> receiver;
+	DatagramSender<std::string> sender;
+	boost::asio::ip::udp::socket udpSocket;
+	boost::asio::ip::tcp::socket tcpSocket;
+	Waiter waiter;
+
+	PreEncodedRequest(asionet::Context & context)
+		: server(context, 10000)
+		, client(context)
+		, receiver(context, 10001, 2000)
+		, sender(context)
+		, udpSocket(context)
+		, tcpSocket(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		server.advertiseService(
+			[self](const auto & clientEndpoint, const auto & request, auto & response)
+			{ response = TestMessage::response(request.getId(), 43); });
+
+		// Encode the request once and send the same bytes twice.
+		auto request = std::make_shared<std::string>();
+		message::Encoder<TestMessage>{}(TestMessage::request(42), *request);
+		std::shared_ptr<const std::string> encodedRequest = request;
+		for (int i = 0; i < 2; ++i)
+		{
+			Waitable waitable{waiter};
+			client.asyncCall(encodedRequest, "127.0.0.1", 10000, 1s,
+			                 waitable([self](const auto & error, const auto & response)
+			                          {
+				                          EXPECT_FALSE(error);
+				                          EXPECT_EQ(response.getId(), 42);
+			                          }));
+			waiter.await(waitable);
+		}
+
+		Waitable waitable{waiter};
+		receiver.asyncReceive(1s, waitable([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                   {
+			                                   EXPECT_FALSE(error);
+			                                   EXPECT_EQ(message, std::string(1000, 'x'));
+		                                   }));
+		sender.asyncSend(std::make_shared<const std::string>(1000, 'x'), "127.0.0.1", 10001, 1s,
+		                 [self](const auto & error) { EXPECT_FALSE(error); });
+		waiter.await(waitable);
+
+		// Non-const strings are sent as pre-encoded bytes as well instead of being taken for messages.
+		auto bytes = std::make_shared<std::string>(500, 'y');
+		Waitable received{waiter}, sent{waiter};
+		receiver.asyncReceive(1s, received([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                   { EXPECT_EQ(message, std::string(500, 'y')); }));
+		udpSocket.open(boost::asio::ip::udp::v4());
+		message::asyncSendDatagram(udpSocket, bytes, "127.0.0.1", 10001, 1s,
+		                           sent([self](const auto & error) { EXPECT_FALSE(error); }));
+		waiter.await(received && sent);
+
+		// The stream isn't connected, so only the overload resolution is of interest here.
+		Waitable streamSent{waiter};
+		message::asyncSend(tcpSocket, bytes, 1s, streamSent([self](const auto & error) { EXPECT_TRUE(error); }));
+		waiter.await(streamSent);
+	}
+};
+
+TEST(asionetTest, PreEncodedRequest)
+{
+	runTest1<PreEncodedRequest>();
+}
+
+
+struct ProxyService : std::enable_shared_from_this<ProxyService>
+{
+	using Endpoint = boost::asio::ip::tcp::endpoint;
+
+	ServiceServer<TestService> backend1;
+	ServiceServer<TestService> backend2;
+	ServiceProxy<TestService> proxy;
+	ServiceClient<TestService> client;
+	Waiter waiter;
+	std::vector<Value> values;
+
+	ProxyService(asionet::Context & context)
+		: backend1(context, 10001)
+		, backend2(context, 10002)
+		, proxy(context, 10000, {Endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10001},
+		                         Endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10002}})
+		, client(context)
+		, waiter(context)
+	{}
+
+	void call(Id id)
+	{
+		auto self = shared_from_this();
+		Waitable waitable{waiter};
+		client.asyncCall(TestMessage::request(id), "127.0.0.1", 10000, 1s,
+		                 waitable([&, self](const auto & error, const auto & response)
+		                          {
+			                          EXPECT_FALSE(error);
+			                          EXPECT_EQ(response.getId(), id);
+			                          values.push_back(response.getValue());
+		                          }));
+		waiter.await(waitable);
+	}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		backend1.advertiseService([self](const auto & clientEndpoint, const auto & request, auto & response)
+		                          { response = TestMessage::response(request.getId(), 1); });
+		backend2.advertiseService([self](const auto & clientEndpoint, const auto & request, auto & response)
+		                          { response = TestMessage::response(request.getId(), 2); });
+
+		proxy.advertiseProxy();
+		call(1);
+		call(2);
+		call(3);
+		EXPECT_EQ(values, (std::vector<Value>{1, 2, 1}));
+
+		// Route by the first byte of the encoded request id.
+		proxy.advertiseProxy([](const auto & clientEndpoint, const auto & request, auto numBackends)
+		                     { return (std::size_t) request[0] % numBackends; });
+		values.clear();
+		call(4);
+		call(5);
+		EXPECT_EQ(values, (std::vector<Value>{1, 2}));
+	}
+};
+
+TEST(asionetTest, ProxyService)
+{
+	runTest1<ProxyService>();
+}
+
+
+struct DeltaDatagram : std::enable_shared_from_this<DeltaDatagram>
+{
+	DeltaDatagramReceiver<std::string> receiver;
+	DeltaDatagramSender<std::string> sender;
+	Waiter waiter;
+
+	DeltaDatagram(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context, 3)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::string state(200, 'a');
+		for (std::size_t i = 0; i < 7; ++i)
+		{
+			state[i * 10] = 'b';
+			if (i == 5)
+				state.resize(250, '\0');
+
+			Waitable waitable{waiter};
+			receiver.asyncReceive(1s, waitable([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			                                   {
+				                                   EXPECT_FALSE(error);
+				                                   EXPECT_EQ(message, state);
+			                                   }));
+			sender.asyncSend(state, "127.0.0.1", 10000, 1s, [self](const auto & error) { EXPECT_FALSE(error); });
+			waiter.await(waitable);
+		}
+	}
+};
+
+TEST(asionetTest, DeltaDatagram)
+{
+	runTest1<DeltaDatagram>();
+}
+
+struct DeltaSenderLimit : std::enable_shared_from_this<DeltaSenderLimit>
+{
+	DeltaDatagramReceiver<std::string> receiver;
+	DeltaDatagramSender<std::string> sender1;
+	DeltaDatagramSender<std::string> sender2;
+	Waiter waiter;
+
+	DeltaSenderLimit(asionet::Context & context)
+		: receiver(context, 10000, 512, 1)
+		, sender1(context)
+		, sender2(context)
+		, waiter(context)
+	{}
+
+	void send(DeltaDatagramSender<std::string> & sender, const std::string & state, const error::Error & expectedError)
+	{
+		auto self = shared_from_this();
+		Waitable waitable{waiter};
+		receiver.asyncReceive(1s, waitable([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                   {
+			                                   EXPECT_EQ(error, expectedError);
+			                                   if (!error)
+			                                   {
+				                                   EXPECT_EQ(message, state);
+			                                   }
+		                                   }));
+		sender.asyncSend(state, "127.0.0.1", 10000, 1s, [self](const auto & error) { EXPECT_FALSE(error); });
+		waiter.await(waitable);
+	}
+
+	void run()
+	{
+		std::string state(200, 'a');
+		send(sender1, state, error::success);
+		// The keyframe of the second sender replaces the baseline of the first one.
+		send(sender2, state, error::success);
+		state[0] = 'b';
+		send(sender1, state, error::missingBaseline);
+		send(sender2, state, error::success);
+	}
+};
+
+TEST(asionetTest, DeltaSenderLimit)
+{
+	runTest1<DeltaSenderLimit>();
+}
+
+TEST(asionetTest, DeltaEncoding)
+{
+	std::string baseline(100, 'a');
+	auto message = baseline;
+	message[10] = 'b';
+	message[12] = 'c';
+	message[90] = 'd';
+	std::string data;
+	delta::internal::encodeDelta(baseline, message, data);
+	// The changes at 10 and 12 share a run, the one at 90 starts a new run.
+	EXPECT_EQ(data.size(), 1 + 2 + 3 + 2 + 1);
+	auto decoded = delta::internal::decodeDelta(baseline, data.data(), data.data() + data.size(), 512);
+	EXPECT_EQ(std::string(decoded.begin(), decoded.end()), message);
+	EXPECT_THROW(delta::internal::decodeDelta(baseline, data.data(), data.data() + data.size() - 1, 512),
+	             std::runtime_error);
+}
+
+
+struct BatchDatagram : std::enable_shared_from_this<BatchDatagram>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	BatchDatagram(asionet::Context & context)
+		: receiver(context, 10000, 512, 8)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		// The first batch binds the receiver's socket.
+		Waitable first{waiter};
+		receiver.asyncReceiveBatch(1s, first([self](const auto & error, auto & datagrams)
+		                                     {
+			                                     EXPECT_FALSE(error);
+			                                     ASSERT_EQ(datagrams.size(), 1);
+			                                     EXPECT_EQ(datagrams[0].message.getId(), 0);
+		                                     }));
+		sender.asyncSend(TestMessage::request(0), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(first);
+
+		// Queue more datagrams than fit into one batch before receiving them.
+		std::vector<std::unique_ptr<Waitable>> sends;
+		for (std::size_t i = 1; i <= 10; ++i)
+		{
+			sends.push_back(std::make_unique<Waitable>(waiter));
+			sender.asyncSend(TestMessage::request(i), "127.0.0.1", 10000, 1s,
+			                 (*sends.back())([self](const auto & error) { EXPECT_FALSE(error); }));
+		}
+		for (const auto & send : sends)
+			waiter.await(*send);
+
+		Waitable second{waiter};
+		receiver.asyncReceiveBatch(1s, second([self](const auto & error, auto & datagrams)
+		                                      {
+			                                      EXPECT_FALSE(error);
+			                                      ASSERT_EQ(datagrams.size(), 8);
+			                                      for (std::size_t i = 0; i < datagrams.size(); ++i)
+			                                      {
+				                                      EXPECT_FALSE(datagrams[i].error);
+				                                      EXPECT_EQ(datagrams[i].message.getId(), i + 1);
+			                                      }
+		                                      }));
+		waiter.await(second);
+
+		Waitable third{waiter};
+		receiver.asyncReceiveBatch(1s, third([self](const auto & error, auto & datagrams)
+		                                     {
+			                                     EXPECT_FALSE(error);
+			                                     ASSERT_EQ(datagrams.size(), 2);
+			                                     EXPECT_EQ(datagrams[1].message.getId(), 10);
+		                                     }));
+		waiter.await(third);
+	}
+};
+
+TEST(asionetTest, BatchDatagram)
+{
+	runTest1<BatchDatagram>();
+}
+
+
+struct BatchSend : std::enable_shared_from_this<BatchSend>
+{
+	DatagramReceiver<std::string> receiver;
+	DatagramSender<std::string> sender;
+	Waiter waiter;
+
+	BatchSend(asionet::Context & context)
+		: receiver(context, 10000, 512, 16)
+		, sender(context, 32)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::atomic<std::size_t> numSucceeded{0}, numFailed{0};
+		std::vector<std::string> received;
+		bool receiveFailed{false};
+
+		Waitable firstBatch{waiter};
+		auto receiveHandler = [&, self](const auto & error, auto & datagrams)
+		{
+			EXPECT_FALSE(error);
+			receiveFailed = (bool) error;
+			for (auto & datagram : datagrams)
+				received.push_back(datagram.message);
+		};
+		// Binds the receiver's socket before anything is sent.
+		receiver.asyncReceiveBatch(1s, firstBatch(receiveHandler));
+
+		std::vector<std::unique_ptr<Waitable>> sends;
+		for (std::size_t i = 0; i < 100; ++i)
+		{
+			sends.push_back(std::make_unique<Waitable>(waiter));
+			sender.asyncSend(std::to_string(i), "127.0.0.1", 10000, 1s,
+			                 (*sends.back())([&, self](const auto & error) { if (!error) ++numSucceeded; }));
+			if (i == 50)
+			{
+				// Exceeds the maximum size of a UDP datagram. Only this message should fail.
+				sends.push_back(std::make_unique<Waitable>(waiter));
+				sender.asyncSend(std::string(70000, 'a'), "127.0.0.1", 10000, 1s,
+				                 (*sends.back())([&, self](const auto & error) { if (error) ++numFailed; }));
+			}
+		}
+		for (const auto & send : sends)
+			waiter.await(*send);
+
+		EXPECT_EQ(numSucceeded, 100);
+		EXPECT_EQ(numFailed, 1);
+
+		waiter.await(firstBatch);
+		while (received.size() < 100 && !receiveFailed)
+		{
+			Waitable batch{waiter};
+			receiver.asyncReceiveBatch(1s, batch(receiveHandler));
+			waiter.await(batch);
+		}
+
+		ASSERT_EQ(received.size(), 100);
+		for (std::size_t i = 0; i < received.size(); ++i)
+			EXPECT_EQ(received[i], std::to_string(i));
+	}
+};
+
+TEST(asionetTest, BatchSend)
+{
+	runTest1<BatchSend>();
+}
+
+
+struct SegmentationOffload : std::enable_shared_from_this<SegmentationOffload>
+{
+	DatagramReceiver<std::string> receiver;
+	DatagramSender<std::string> sender;
+	Waiter waiter;
+
+	SegmentationOffload(asionet::Context & context)
+		: receiver(context, 10000, 512, 8)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		EXPECT_TRUE(receiver.enableGro());
+		EXPECT_TRUE(sender.enableGso());
+
+		std::vector<std::string> messages;
+		for (std::size_t i = 10; i < 50; ++i)
+			messages.push_back("message " + std::to_string(i));
+		messages.push_back("last");
+
+		auto sendAll = [&]
+		{
+			std::vector<std::unique_ptr<Waitable>> sends;
+			for (const auto & message : messages)
+			{
+				sends.push_back(std::make_unique<Waitable>(waiter));
+				sender.asyncSend(message, "127.0.0.1", 10000, 1s,
+				                 (*sends.back())([self](const auto & error) { EXPECT_FALSE(error); }));
+			}
+			for (const auto & send : sends)
+				waiter.await(*send);
+		};
+
+		sendAll();
+		std::vector<std::string> received;
+		bool receiveFailed{false};
+		while (received.size() < messages.size() && !receiveFailed)
+		{
+			Waitable batch{waiter};
+			receiver.asyncReceiveBatch(1s, batch([&, self](const auto & error, auto & datagrams)
+			                                     {
+				                                     receiveFailed = (bool) error;
+				                                     for (auto & datagram : datagrams)
+				                                     {
+					                                     EXPECT_FALSE(datagram.error);
+					                                     received.push_back(datagram.message);
+				                                     }
+			                                     }));
+			waiter.await(batch);
+		}
+
+		EXPECT_EQ(received, messages);
+
+		// asyncReceive() splits coalesced datagrams as well.
+		sendAll();
+		received.clear();
+		while (received.size() < messages.size() && !receiveFailed)
+		{
+			Waitable waitable{waiter};
+			receiver.asyncReceive(1s, waitable([&, self](const auto & error, auto & message, const auto &)
+			                                   {
+				                                   receiveFailed = (bool) error;
+				                                   if (!error)
+					                                   received.push_back(message);
+			                                   }));
+			waiter.await(waitable);
+		}
+
+		EXPECT_EQ(received, messages);
+	}
+};
+
+TEST(asionetTest, SegmentationOffload)
+{
+	runTest1<SegmentationOffload>();
+}
+
+TEST(asionetTest, Segmentation)
+{
+	using asionet::internal::Frame;
+	using asionet::socket::internal::OutgoingDatagram;
+	using asionet::socket::internal::numSegments;
+
+	std::string a(100, 'a'), b(50, 'b'), c(2000, 'c');
+	Frame frameA{(const std::uint8_t *) a.data(), (std::uint32_t) a.size()};
+	Frame frameB{(const std::uint8_t *) b.data(), (std::uint32_t) b.size()};
+	Frame frameC{(const std::uint8_t *) c.data(), (std::uint32_t) c.size()};
+	boost::asio::ip::udp::endpoint endpoint1{boost::asio::ip::address_v4::loopback(), 10000};
+	boost::asio::ip::udp::endpoint endpoint2{boost::asio::ip::address_v4::loopback(), 10001};
+
+	// Equal sizes are segmented, a shorter datagram ends the segment.
+	std::vector<OutgoingDatagram> datagrams{
+		{&frameA, endpoint1}, {&frameA, endpoint1}, {&frameB, endpoint1}, {&frameA, endpoint1}};
+	EXPECT_EQ(numSegments(datagrams.data(), datagrams.size(), 64), 3);
+	EXPECT_EQ(numSegments(datagrams.data(), datagrams.size(), 2), 2);
+	EXPECT_EQ(numSegments(datagrams.data(), datagrams.size(), 1), 1);
+	// Larger datagrams and other endpoints end the segment as well.
+	datagrams = {{&frameB, endpoint1}, {&frameA, endpoint1}};
+	EXPECT_EQ(numSegments(datagrams.data(), datagrams.size(), 64), 1);
+	datagrams = {{&frameA, endpoint1}, {&frameA, endpoint2}};
+	EXPECT_EQ(numSegments(datagrams.data(), datagrams.size(), 64), 1);
+	// Datagrams which may exceed the MTU are never segmented.
+	datagrams = {{&frameC, endpoint1}, {&frameC, endpoint1}};
+	EXPECT_EQ(numSegments(datagrams.data(), datagrams.size(), 64), 1);
+}
+
+
+struct ContinuousReceive : std::enable_shared_from_this<ContinuousReceive>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	ContinuousReceive(asionet::Context & context)
+		: receiver(context, 10000, 512, 4)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::vector<Id> ids;
+		error::Error lastError;
+
+		// Receiving stops with an aborted error once no datagram arrived for 200ms.
+		Waitable stopped{waiter};
+		receiver.startReceiving(
+			200ms,
+			[&, self, handler = stopped([](){})](const auto & error, auto & message, const auto & senderEndpoint) mutable
+			{
+				if (error)
+				{
+					lastError = error;
+					handler();
+					return;
+				}
+				ids.push_back(message.getId());
+			});
+
+		for (std::size_t i = 0; i < 20; ++i)
+		{
+			sender.asyncSend(TestMessage::request(i), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+			if (i % 5 == 0)
+				std::this_thread::sleep_for(50ms);
+		}
+
+		waiter.await(stopped);
+		EXPECT_EQ(lastError, error::aborted);
+		ASSERT_EQ(ids.size(), 20);
+		for (std::size_t i = 0; i < ids.size(); ++i)
+			EXPECT_EQ(ids[i], i);
+	}
+};
+
+TEST(asionetTest, ContinuousReceive)
+{
+	runTest1<ContinuousReceive>();
+}
+
+struct ContinuousReceiveCancel : std::enable_shared_from_this<ContinuousReceiveCancel>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	ContinuousReceiveCancel(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::atomic<std::size_t> numReceived{0};
+		Waitable aborted{waiter};
+		receiver.startReceiving(
+			[&, self, handler = aborted([](){})](const auto & error, auto & message, const auto & senderEndpoint) mutable
+			{
+				if (error)
+				{
+					EXPECT_EQ(error, error::aborted);
+					handler();
+					return;
+				}
+				++numReceived;
+			});
+
+		Waitable sent{waiter};
+		sender.asyncSend(TestMessage::request(1), "127.0.0.1", 10000, 1s, sent([self](const auto & error) {}));
+		waiter.await(sent);
+		std::this_thread::sleep_for(50ms);
+		EXPECT_EQ(numReceived, 1);
+
+		// Starting another receive operation stops the continuous one.
+		Waitable received{waiter};
+		receiver.asyncReceive(1s, received([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                   {
+			                                   EXPECT_FALSE(error);
+			                                   EXPECT_EQ(message.getId(), 2);
+		                                   }));
+		waiter.await(aborted);
+		sender.asyncSend(TestMessage::request(2), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(received);
+		EXPECT_EQ(numReceived, 1);
+	}
+};
+
+TEST(asionetTest, ContinuousReceiveCancel)
+{
+	runTest1<ContinuousReceiveCancel>();
+}
+
+struct ContinuousReceiveRestart : std::enable_shared_from_this<ContinuousReceiveRestart>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	ContinuousReceiveRestart(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::atomic<std::size_t> numReceived{0};
+		auto handler = [&, self](const auto & error, auto & message, const auto & senderEndpoint)
+		{
+			if (!error)
+				++numReceived;
+		};
+
+		// The idle timer of the canceled operation must not delay the next one until it expires.
+		receiver.startReceiving(10s, handler);
+		receiver.cancel();
+		receiver.startReceiving(10s, handler);
+
+		for (std::size_t i = 0; i < 100 && numReceived == 0; ++i)
+		{
+			sender.asyncSend(TestMessage::request(1), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+			std::this_thread::sleep_for(10ms);
+		}
+		EXPECT_GT(numReceived, 0);
+		receiver.cancel();
+	}
+};
+
+TEST(asionetTest, ContinuousReceiveRestart)
+{
+	runTest1<ContinuousReceiveRestart>();
+}
+
+
+struct ConcurrentSend : std::enable_shared_from_this<ConcurrentSend>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	ConcurrentSend(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		std::mutex mutex;
+		std::set<Id> ids;
+		receiver.startReceiving(
+			[&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			{
+				if (error)
+					return;
+				std::lock_guard<std::mutex> lock{mutex};
+				ids.insert(message.getId());
+			});
+
+		sender.enableConcurrentSends();
+		std::atomic<std::size_t> numSucceeded{0};
+		std::vector<std::thread> threads;
+		for (std::size_t t = 0; t < 4; ++t)
+		{
+			threads.emplace_back(
+				[&, t]
+				{
+					for (std::size_t i = 0; i < 50; ++i)
+						sender.asyncSend(TestMessage::request(t * 50 + i), "127.0.0.1", 10000, 1s,
+						                 [&, self](const auto & error) { if (!error) ++numSucceeded; });
+				});
+		}
+		for (auto & thread : threads)
+			thread.join();
+
+		auto numReceived = [&]
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			return ids.size();
+		};
+		for (std::size_t i = 0; i < 100 && (numSucceeded < 200 || numReceived() < 200); ++i)
+			std::this_thread::sleep_for(10ms);
+
+		EXPECT_EQ(numSucceeded, 200);
+		std::lock_guard<std::mutex> lock{mutex};
+		EXPECT_EQ(ids.size(), 200);
+		receiver.cancel();
+	}
+};
+
+TEST(asionetTest, ConcurrentSend)
+{
+	runTest1<ConcurrentSend>(4);
+}
+
+
+struct Multicast : std::enable_shared_from_this<Multicast>
+{
+	DatagramReceiver<TestMessage> receiver1, receiver2;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	Multicast(asionet::Context & context)
+		: receiver1(context, 10000)
+		, receiver2(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		receiver1.joinGroup("239.255.0.1", "127.0.0.1");
+		receiver2.joinGroup("239.255.0.1", "127.0.0.1");
+		sender.setMulticastInterface("127.0.0.1");
+		sender.setMulticastTtl(1);
+		sender.setMulticastLoopback(true);
+
+		// A single send reaches both subscribers.
+		Waitable w1{waiter}, w2{waiter};
+		receiver1.asyncReceive(1s, w1([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                              {
+			                              EXPECT_FALSE(error);
+			                              EXPECT_EQ(message.getId(), 1);
+		                              }));
+		receiver2.asyncReceive(1s, w2([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                              {
+			                              EXPECT_FALSE(error);
+			                              EXPECT_EQ(message.getId(), 1);
+		                              }));
+		sender.asyncSend(TestMessage::request(1), "239.255.0.1", 10000, 1s,
+		                 [self](const auto & error) { EXPECT_FALSE(error); });
+		waiter.await(w1 && w2);
+
+		// Unsubscribed receivers don't get any datagrams of the group anymore.
+		receiver2.leaveGroup("239.255.0.1");
+		Waitable w3{waiter}, w4{waiter};
+		receiver1.asyncReceive(1s, w3([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                              {
+			                              EXPECT_FALSE(error);
+			                              EXPECT_EQ(message.getId(), 2);
+		                              }));
+		receiver2.asyncReceive(200ms, w4([self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                 {
+			                                 EXPECT_EQ(error, error::aborted);
+		                                 }));
+		sender.asyncSend(TestMessage::request(2), "239.255.0.1", 10000, 1s,
+		                 [self](const auto & error) { EXPECT_FALSE(error); });
+		waiter.await(w3 && w4);
+	}
+};
+
+TEST(asionetTest, Multicast)
+{
+	runTest1<Multicast>();
+}
+
+
+struct ShardedReceive : std::enable_shared_from_this<ShardedReceive>
+{
+	ShardedDatagramReceiver<TestMessage> receiver;
+	std::vector<std::unique_ptr<DatagramSender<TestMessage>>> senders;
+	Waiter waiter;
+
+	ShardedReceive(asionet::Context & context)
+		: receiver(context, 4, 10000)
+		, waiter(context)
+	{
+		// The kernel distributes datagrams by sender, so use several senders (i.e. source ports).
+		for (std::size_t i = 0; i < 8; ++i)
+			senders.push_back(std::make_unique<DatagramSender<TestMessage>>(context));
+	}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		EXPECT_EQ(receiver.getNumShards(), 4);
+
+		std::mutex mutex;
+		std::set<Id> ids;
+		receiver.startReceiving(
+			[&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			{
+				if (error)
+					return;
+				std::lock_guard<std::mutex> lock{mutex};
+				ids.insert(message.getId());
+			});
+
+		for (std::size_t i = 0; i < 80; ++i)
+			senders[i % senders.size()]->asyncSend(TestMessage::request(i), "127.0.0.1", 10000, 1s,
+			                                       [self](const auto & error) { EXPECT_FALSE(error); });
+
+		auto numReceived = [&]
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			return ids.size();
+		};
+		for (std::size_t i = 0; i < 100 && numReceived() < 80; ++i)
+			std::this_thread::sleep_for(10ms);
+
+		EXPECT_EQ(numReceived(), 80);
+		receiver.cancel();
+	}
+};
+
+TEST(asionetTest, ShardedReceive)
+{
+	runTest1<ShardedReceive>(4);
+}
+
+
+struct DropCounter : std::enable_shared_from_this<DropCounter>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	DropCounter(asionet::Context & context)
+		: receiver(context, 10000, 512, 16)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		EXPECT_GE(sender.setSendBufferSize(0x10000), 0x10000);
+		// Only holds a few datagrams.
+		EXPECT_GE(receiver.setReceiveBufferSize(0x2000), 0x2000);
+		EXPECT_TRUE(receiver.enableDropCounter());
+
+		std::vector<std::unique_ptr<Waitable>> sends;
+		for (std::size_t i = 0; i < 200; ++i)
+		{
+			sends.push_back(std::make_unique<Waitable>(waiter));
+			sender.asyncSend(TestMessage::request(i), "127.0.0.1", 10000, 1s,
+			                 (*sends.back())([self](const auto & error) { EXPECT_FALSE(error); }));
+		}
+		for (const auto & send : sends)
+			waiter.await(*send);
+
+		std::size_t numReceived{0}, numDropped{0};
+		auto receiveAll = [&]
+		{
+			// A batch which isn't full has drained the socket.
+			bool drained{false};
+			while (!drained)
+			{
+				Waitable batch{waiter};
+				receiver.asyncReceiveBatch(1s, batch([&, self](const auto & error, auto & datagrams)
+				                                     {
+					                                     EXPECT_FALSE(error);
+					                                     drained = error || datagrams.size() < 16;
+					                                     numReceived += datagrams.size();
+					                                     for (const auto & datagram : datagrams)
+						                                     numDropped += datagram.numDropped;
+				                                     }));
+				waiter.await(batch);
+			}
+		};
+		receiveAll();
+
+		// The kernel reports the drops along with the next datagram which it queues.
+		Waitable last{waiter};
+		sender.asyncSend(TestMessage::request(200), "127.0.0.1", 10000, 1s, last([self](const auto & error) {}));
+		waiter.await(last);
+		receiveAll();
+
+		EXPECT_GT(numDropped, 0);
+		EXPECT_EQ(numReceived + numDropped, 201);
+		EXPECT_EQ(receiver.getNumDropped(), numDropped);
+
+		// A timeout closes the socket whose successor counts its drops from zero again.
+		Waitable timedOut{waiter};
+		receiver.asyncReceiveBatch(10ms, timedOut([self](const auto & error, auto & datagrams)
+		                                          { EXPECT_EQ(error, error::aborted); }));
+		waiter.await(timedOut);
+		// Binds the new socket.
+		EXPECT_TRUE(receiver.enableDropCounter());
+
+		sends.clear();
+		for (std::size_t i = 0; i < 30; ++i)
+		{
+			sends.push_back(std::make_unique<Waitable>(waiter));
+			sender.asyncSend(TestMessage::request(i), "127.0.0.1", 10000, 1s,
+			                 (*sends.back())([self](const auto & error) { EXPECT_FALSE(error); }));
+		}
+		for (const auto & send : sends)
+			waiter.await(*send);
+		receiveAll();
+
+		Waitable next{waiter};
+		sender.asyncSend(TestMessage::request(30), "127.0.0.1", 10000, 1s, next([self](const auto & error) {}));
+		waiter.await(next);
+		receiveAll();
+
+		EXPECT_EQ(numReceived + numDropped, 201 + 31);
+		EXPECT_EQ(receiver.getNumDropped(), numDropped);
+	}
+};
+
+TEST(asionetTest, DropCounter)
+{
+	runTest1<DropCounter>();
+}
+
+
+struct ReceiveTimestamps : std::enable_shared_from_this<ReceiveTimestamps>
+{
+	DatagramReceiver<TestMessage> receiver;
+	DatagramSender<TestMessage> sender;
+	Waiter waiter;
+
+	ReceiveTimestamps(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		EXPECT_TRUE(receiver.enableTimestamps());
+
+		auto before = asionet::time::now();
+		Waitable sent{waiter};
+		sender.asyncSend(TestMessage::request(1), "127.0.0.1", 10000, 1s, sent([self](const auto & error) {}));
+		waiter.await(sent);
+		auto after = asionet::time::now();
+		// The datagram waits in the socket's receive buffer.
+		std::this_thread::sleep_for(50ms);
+
+		Waitable batch{waiter};
+		receiver.asyncReceiveBatch(1s, batch([&, self](const auto & error, auto & datagrams)
+		                                     {
+			                                     EXPECT_FALSE(error);
+			                                     ASSERT_EQ(datagrams.size(), 1);
+			                                     EXPECT_GE(datagrams[0].timestamp, before);
+			                                     EXPECT_LE(datagrams[0].timestamp, after);
+		                                     }));
+		waiter.await(batch);
+
+		Waitable received{waiter};
+		receiver.startReceivingTimestamped(
+			[&, self, handler = received([](){})]
+				(const auto & error, auto & message, const auto & senderEndpoint, auto timestamp) mutable
+			{
+				EXPECT_FALSE(error);
+				EXPECT_EQ(message.getId(), 2);
+				EXPECT_GE(timestamp, before);
+				EXPECT_LE(timestamp, asionet::time::now());
+				handler();
+			});
+		before = asionet::time::now();
+		sender.asyncSend(TestMessage::request(2), "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		waiter.await(received);
+		receiver.cancel();
+	}
+};
+
+TEST(asionetTest, ReceiveTimestamps)
+{
+	runTest1<ReceiveTimestamps>();
+}
+
+
+struct Fragmentation : std::enable_shared_from_this<Fragmentation>
+{
+	DatagramReceiver<std::string> receiver;
+	DatagramSender<std::string> sender;
+	Waiter waiter;
+
+	Fragmentation(asionet::Context & context)
+		: receiver(context, 10000)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		receiver.enableReassembly();
+		sender.enableFragmentation();
+		sender.enableChecksum();
+
+		std::string large;
+		for (std::size_t i = 0; large.size() < 50000; ++i)
+			large += std::to_string(i) + ',';
+
+		Waitable received{waiter}, sent{waiter};
+		receiver.asyncReceive(1s, received([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                   {
+			                                   EXPECT_FALSE(error);
+			                                   EXPECT_EQ(message, large);
+		                                   }));
+		sender.asyncSend(large, "127.0.0.1", 10000, 1s, sent([self](const auto & error) { EXPECT_FALSE(error); }));
+		waiter.await(received && sent);
+
+		std::vector<std::string> messages{large, "small", large.substr(1000)};
+		for (const auto & message : messages)
+			sender.asyncSend(message, "127.0.0.1", 10000, 1s, [self](const auto & error) { EXPECT_FALSE(error); });
+
+		std::vector<std::string> receivedMessages;
+		bool receiveFailed{false};
+		while (receivedMessages.size() < messages.size() && !receiveFailed)
+		{
+			Waitable batch{waiter};
+			receiver.asyncReceiveBatch(1s, batch([&, self](const auto & error, auto & datagrams)
+			                                     {
+				                                     receiveFailed = (bool) error;
+				                                     for (auto & datagram : datagrams)
+				                                     {
+					                                     EXPECT_FALSE(datagram.error);
+					                                     receivedMessages.push_back(datagram.message);
+				                                     }
+			                                     }));
+			waiter.await(batch);
+		}
+
+		EXPECT_EQ(receivedMessages, messages);
+	}
+};
+
+TEST(asionetTest, Fragmentation)
+{
+	runTest1<Fragmentation>();
+}
+
+TEST(asionetTest, Reassembly)
+{
+	using namespace asionet::fragment::internal;
+
+	asionet::utils::ObjectPool<std::vector<char>> bufferPool;
+	boost::asio::ip::udp::endpoint sender1{boost::asio::ip::address_v4::loopback(), 10000};
+	boost::asio::ip::udp::endpoint sender2{boost::asio::ip::address_v4::loopback(), 10001};
+	std::string message{"abcdefghij"};
+	auto fragment = [&](std::uint32_t messageId, std::uint16_t index)
+	{ return Fragment{messageId, index, 4, message.data() + index * 3, index == 3 ? 1u : 3u}; };
+	auto toString = [](const auto & bytes) { return std::string{bytes->begin(), bytes->end()}; };
+
+	Reassembler reassembler{1s, 100, bufferPool};
+	// Fragments of two senders with the same message id arrive interleaved, out of order and duplicated.
+	EXPECT_EQ(reassembler.add(sender1, fragment(1, 2)), nullptr);
+	EXPECT_EQ(reassembler.add(sender2, fragment(1, 3)), nullptr);
+	EXPECT_EQ(reassembler.add(sender1, fragment(1, 0)), nullptr);
+	EXPECT_EQ(reassembler.add(sender1, fragment(1, 0)), nullptr);
+	EXPECT_EQ(reassembler.add(sender1, fragment(1, 3)), nullptr);
+	EXPECT_EQ(reassembler.getNumIncomplete(), 2);
+	auto reassembled = reassembler.add(sender1, fragment(1, 1));
+	ASSERT_NE(reassembled, nullptr);
+	EXPECT_EQ(toString(reassembled), message);
+	EXPECT_EQ(reassembler.getNumIncomplete(), 1);
+	EXPECT_EQ(reassembler.getNumBufferedBytes(), 1);
+
+	// A fragment which doesn't fit into memory drops the oldest incomplete message.
+	Reassembler smallReassembler{1s, 10, bufferPool};
+	for (std::uint32_t messageId = 1; messageId <= 4; ++messageId)
+		EXPECT_EQ(smallReassembler.add(sender1, fragment(messageId, 0)), nullptr);
+	EXPECT_EQ(smallReassembler.getNumIncomplete(), 3);
+	EXPECT_EQ(smallReassembler.getNumBufferedBytes(), 9);
+	// A message which can't fit into memory at all is dropped right away.
+	Reassembler tinyReassembler{1s, 8, bufferPool};
+	EXPECT_EQ(tinyReassembler.add(sender1, fragment(1, 0)), nullptr);
+	EXPECT_EQ(tinyReassembler.getNumIncomplete(), 0);
+	// A message's memory grows with the fragments which arrived, not with the number of fragments it announces.
+	auto numAllocatedBytesBefore = numAllocatedBytes;
+	countAllocations = true;
+	EXPECT_EQ(tinyReassembler.add(sender1, Fragment{2, MAX_FRAGMENTS - 1, MAX_FRAGMENTS, message.data(), 1}), nullptr);
+	countAllocations = false;
+	EXPECT_EQ(tinyReassembler.getNumIncomplete(), 1);
+	EXPECT_LT(numAllocatedBytes - numAllocatedBytesBefore, 1024);
+
+	// Fragments which arrive after the timeout start a new message.
+	Reassembler fastReassembler{10ms, 100, bufferPool};
+	EXPECT_EQ(fastReassembler.add(sender1, fragment(1, 0)), nullptr);
+	EXPECT_EQ(fastReassembler.add(sender1, fragment(1, 1)), nullptr);
+	std::this_thread::sleep_for(20ms);
+	EXPECT_EQ(fastReassembler.add(sender1, fragment(1, 2)), nullptr);
+	EXPECT_EQ(fastReassembler.add(sender1, fragment(1, 3)), nullptr);
+	EXPECT_EQ(fastReassembler.getNumBufferedBytes(), 4);
+
+	// Splitting and reassembling round-trips.
+	std::string large(1000, 'x');
+	for (std::size_t i = 0; i < large.size(); ++i)
+		large[i] = (char) i;
+	Reassembler largeReassembler{1s, 0x10000, bufferPool};
+	auto fragments = split(large, 100, 7);
+	EXPECT_EQ(fragments.size(), 11);
+	std::shared_ptr<std::vector<char>> result;
+	for (auto it = fragments.rbegin(); it != fragments.rend(); ++it)
+	{
+		asionet::internal::Frame frame{(const std::uint8_t *) (*it)->data(), (std::uint32_t) (*it)->size(), true,
+		                               asionet::internal::Frame::FRAGMENT_FLAG};
+		std::string datagram;
+		for (const auto & buffer : frame.getBuffers())
+			datagram.append((const char *) buffer.data(), buffer.size());
+		ASSERT_TRUE(isFragment(datagram.data(), datagram.size()));
+		Fragment parsed;
+		ASSERT_TRUE(parseFragment(datagram.data(), datagram.size(), parsed));
+		EXPECT_EQ(parsed.messageId, 7);
+		result = largeReassembler.add(sender2, parsed);
+	}
+	ASSERT_NE(result, nullptr);
+	EXPECT_EQ(toString(result), large);
+}
+
+
+struct FragmentationOffload : std::enable_shared_from_this<FragmentationOffload>
+{
+	DatagramReceiver<std::string> receiver;
+	DatagramSender<std::string> sender;
+	Waiter waiter;
+
+	FragmentationOffload(asionet::Context & context)
+		: receiver(context, 10000, 512, 8)
+		, sender(context)
+		, waiter(context)
+	{}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		receiver.enableReassembly();
+		EXPECT_TRUE(receiver.enableGro());
+		EXPECT_TRUE(sender.enableGso());
+		sender.enableFragmentation();
+
+		// Queued together, so the kernel may coalesce them into few slots.
+		std::vector<std::string> messages;
+		for (std::size_t i = 10; i < 40; ++i)
+			messages.push_back("message " + std::to_string(i));
+		messages.push_back(std::string(10000, 'x'));
+		messages.push_back("last");
+
+		std::vector<std::unique_ptr<Waitable>> sends;
+		for (const auto & message : messages)
+		{
+			sends.push_back(std::make_unique<Waitable>(waiter));
+			sender.asyncSend(message, "127.0.0.1", 10000, 1s,
+			                 (*sends.back())([self](const auto & error) { EXPECT_FALSE(error); }));
+		}
+		for (const auto & send : sends)
+			waiter.await(*send);
+
+		// Each coalesced datagram is passed to its own asyncReceive() call.
+		std::vector<std::string> received;
+		bool receiveFailed{false};
+		while (received.size() < messages.size() && !receiveFailed)
+		{
+			Waitable next{waiter};
+			receiver.asyncReceive(1s, next([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+			                               {
+				                               receiveFailed = (bool) error;
+				                               if (!error)
+					                               received.push_back(message);
+			                               }));
+			waiter.await(next);
+		}
+
+		EXPECT_EQ(received, messages);
+
+		// Batches pick up where asyncReceive() left off.
+		for (std::size_t i = 0; i < 3; ++i)
+			sender.asyncSend(messages[i], "127.0.0.1", 10000, 1s, [self](const auto & error) {});
+		Waitable first{waiter};
+		receiver.asyncReceive(1s, first([&, self](const auto & error, auto & message, const auto & senderEndpoint)
+		                                { EXPECT_EQ(message, messages[0]); }));
+		waiter.await(first);
+		received.clear();
+		while (received.size() < 2 && !receiveFailed)
+		{
+			Waitable batch{waiter};
+			receiver.asyncReceiveBatch(1s, batch([&, self](const auto & error, auto & datagrams)
+			                                     {
+				                                     receiveFailed = (bool) error;
+				                                     for (auto & datagram : datagrams)
+					                                     received.push_back(datagram.message);
+			                                     }));
+			waiter.await(batch);
+		}
+		EXPECT_EQ(received, (std::vector<std::string>{messages[1], messages[2]}));
+	}
+};
+
+TEST(asionetTest, FragmentationOffload)
+{
+	runTest1<FragmentationOffload>();
+}
+
+
+struct ProxyKeepAlive : std::enable_shared_from_this<ProxyKeepAlive>
+{
+	using Endpoint = boost::asio::ip::tcp::endpoint;
+
+	ServiceServer<TestService> backend1;
+	ServiceServer<TestService> backend2;
+	ServiceProxy<TestService> proxy;
+	ServiceClient<TestService> client;
+	Waiter waiter;
+	std::vector<Endpoint> proxyEndpoints;
+
+	ProxyKeepAlive(asionet::Context & context)
+		: backend1(context, 10021)
+		, backend2(context, 10022)
+		, proxy(context, 10020, {Endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10021},
+		                         Endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10022}})
+		, client(context)
+		, waiter(context)
+	{}
+
+	void call(Id id)
+	{
+		auto self = shared_from_this();
+		Waitable waitable{waiter};
+		client.asyncCall(TestMessage::request(id), "127.0.0.1", 10020, 1s,
+		                 waitable([&, self](const auto & error, const auto & response)
+		                          {
+			                          EXPECT_FALSE(error);
+			                          EXPECT_EQ(response.getId(), id);
+		                          }));
+		waiter.await(waitable);
+	}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		backend1.enableKeepAlive();
+		backend2.enableKeepAlive();
+		// The first backend closes idle connections quickly.
+		backend1.advertiseService([self](const auto & clientEndpoint, const auto & request, auto & response)
+		                          {
+			                          self->proxyEndpoints.push_back(clientEndpoint);
+			                          response = TestMessage::response(request.getId(), 1);
+		                          }, 100ms);
+		backend2.advertiseService([self](const auto & clientEndpoint, const auto & request, auto & response)
+		                          { response = TestMessage::response(request.getId(), 2); });
+
+		proxy.enableBackendKeepAlive();
+		proxy.advertiseProxy();
+		call(1);
+		call(2);
+		call(3);
+		ASSERT_EQ(proxyEndpoints.size(), 2);
+		EXPECT_EQ(proxyEndpoints[0], proxyEndpoints[1]);
+
+		// The idle connection to the first backend is closed by now, so the proxy has to connect again.
+		std::this_thread::sleep_for(300ms);
+		call(4);
+		call(5);
+		ASSERT_EQ(proxyEndpoints.size(), 3);
+		EXPECT_NE(proxyEndpoints[1], proxyEndpoints[2]);
+	}
+};
+
+TEST(asionetTest, ProxyKeepAlive)
+{
+	runTest1<ProxyKeepAlive>();
+}
+
+struct ProxyNoRetryAfterTimeout : std::enable_shared_from_this<ProxyNoRetryAfterTimeout>
+{
+	using Endpoint = boost::asio::ip::tcp::endpoint;
+
+	ServiceServer<TestService> backend;
+	ServiceProxy<TestService> proxy;
+	ServiceClient<TestService> client;
+	Waiter waiter;
+	std::atomic<int> numRequests{0};
+
+	ProxyNoRetryAfterTimeout(asionet::Context & context)
+		: backend(context, 10024)
+		, proxy(context, 10023, {Endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 10024}})
+		, client(context)
+		, waiter(context)
+	{}
+
+	void call(Id id, bool expectResponse)
+	{
+		auto self = shared_from_this();
+		Waitable waitable{waiter};
+		client.asyncCall(TestMessage::request(id), "127.0.0.1", 10023, 1s,
+		                 waitable([&, self](const auto & error, const auto &)
+		                          {
+			                          EXPECT_EQ(!error, expectResponse);
+		                          }));
+		waiter.await(waitable);
+	}
+
+	void run()
+	{
+		auto self = shared_from_this();
+		backend.enableKeepAlive();
+		// The second request is processed for longer than the proxy waits for the backend.
+		backend.advertiseService([self](const auto &, const auto & request, auto & response)
+		                         {
+			                         self->numRequests++;
+			                         if (request.getId() == 2)
+				                         std::this_thread::sleep_for(300ms);
+			                         response = TestMessage::response(request.getId(), 1);
+		                         });
+
+		proxy.enableBackendKeepAlive();
+		proxy.advertiseProxy(nullptr, 1s, 100ms);
+		call(1, true);
+		// The request is forwarded over the idle connection but must not be sent again after it has timed out.
+		call(2, false);
+		std::this_thread::sleep_for(400ms);
+		EXPECT_EQ(numRequests, 2);
+	}
+};
+
+TEST(asionetTest, ProxyNoRetryAfterTimeout)
+{
+	runTest1<ProxyNoRetryAfterTimeout>(4);
 }
 
 }